@@ -0,0 +1,148 @@
+/* ------------------------------------------------------------ *
+ * file:        adapt_mmc3416.c                                 *
+ * purpose:     Adaptive continuous read frequency. Watches the *
+ *              rate of change of the field vector, and selects *
+ *              the set_cmfreq() mode with hysteresis: a change *
+ *              above the up threshold jumps to 50 Hz with the  *
+ *              next sample, after a quiet period below the     *
+ *              down threshold the rate steps down one mode.    *
+ *              The rate of change is measured over at least    *
+ *              ADAPT_BASE seconds, so the quantization noise   *
+ *              of consecutive 50 Hz samples, about 25..40 mG/s *
+ *              alone, can't hold the rate up on a quiet field. *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mmc3416.h"
+
+/* continuous read frequency in Hz per set_cmfreq() mode 0..3 */
+const float cm_hz[4] = { 1.5, 13, 25, 50 };
+
+/* ------------------------------------------------------------ *
+ * adapt_parse() reads the -a spec "up[:down[:quiet]]": the up  *
+ * and down rate of change thresholds in mGauss/s, and the      *
+ * quiet time in seconds before the rate steps down.            *
+ * ------------------------------------------------------------ */
+int adapt_parse(char *spec, struct mmc3416adapt *ad) {
+   memset(ad, 0, sizeof(struct mmc3416adapt));
+   int n = sscanf(spec, "%f:%f:%f", &ad->up, &ad->down, &ad->quiet);
+   if(n < 1 || ad->up <= 0) return(-1);
+   if(n < 2) ad->down = ad->up / 2;
+   if(n < 3) ad->quiet = 5;
+   if(ad->down <= 0 || ad->down > ad->up || ad->quiet <= 0) return(-1);
+   ad->enabled = 1;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * adapt_start() begins adaptive mode at the given low mode.    *
+ * ------------------------------------------------------------ */
+void adapt_start(struct mmc3416adapt *ad, int minmode, double now) {
+   ad->minmode = minmode;
+   ad->mode = minmode;
+   ad->tstart = now;
+   ad->tmode = now;
+   ad->tquiet = now;
+   ad->havelast = 0;
+   ad->xfers0 = i2c_xfers;
+}
+
+/* ------------------------------------------------------------ *
+ * adapt_setmin() changes the low mode of a running adaptive    *
+ * read, returns the mode to switch to, or -1 if it stays.      *
+ * ------------------------------------------------------------ */
+int adapt_setmin(struct mmc3416adapt *ad, int minmode, double now) {
+   ad->minmode = minmode;
+   if(ad->mode >= minmode) return(-1);
+   ad->tinmode[ad->mode] += now - ad->tmode;
+   ad->tmode = now;
+   ad->tquiet = now;
+   ad->mode = minmode;
+   ad->switches++;
+   return(minmode);
+}
+
+/* ------------------------------------------------------------ *
+ * adapt_update() checks the new raw sample, returns the mode   *
+ * to switch to, or -1 if the current mode stays. The change to *
+ * a reference sample is divided by at least ADAPT_BASE: a big  *
+ * change switches up at once, the quiet check waits until the  *
+ * reference is ADAPT_BASE old, then the reference moves on.    *
+ * ------------------------------------------------------------ */
+int adapt_update(struct mmc3416adapt *ad, struct mmc3416sample *s) {
+   int newmode = -1;
+
+   ad->samples[ad->mode]++;
+   if(ad->havelast == 0) {
+      for(int i=0; i<3; i++) ad->last[i] = s->raw[i];
+      ad->lastts = s->ts;
+      ad->havelast = 1;
+      return(-1);
+   }
+   /* ---------------------------------------------------------- *
+    * rate of change of the field vector in milli Gauss/second,  *
+    * against the reference sample                               *
+    * ---------------------------------------------------------- */
+   double d2 = 0;
+   for(int i=0; i<3; i++) {
+      double d = 0.48828125 * ((int) s->raw[i] - (int) ad->last[i]);
+      d2 += d * d;
+   }
+   double dt = s->ts - ad->lastts;
+   if(dt <= 0) return(-1);
+   double rate = sqrt(d2) / fmax(dt, ADAPT_BASE);
+   if(rate <= ad->up && dt < ADAPT_BASE) return(-1);
+   for(int i=0; i<3; i++) ad->last[i] = s->raw[i];
+   ad->lastts = s->ts;
+
+   if(rate > ad->up) {
+      ad->tquiet = s->ts;
+      if(ad->mode != 3) newmode = 3;
+   }
+   else if(rate > ad->down) {
+      ad->tquiet = s->ts;
+   }
+   else if(s->ts - ad->tquiet >= ad->quiet && ad->mode > ad->minmode) {
+      newmode = ad->mode - 1;
+      ad->tquiet = s->ts;
+   }
+   if(newmode >= 0) {
+      ad->tinmode[ad->mode] += s->ts - ad->tmode;
+      ad->tmode = s->ts;
+      ad->mode = newmode;
+      ad->switches++;
+      if(verbose == 1) printf("Debug: Adaptive rate %.1f mG/s, switch to %.1f Hz\n",
+                               rate, cm_hz[newmode]);
+   }
+   return(newmode);
+}
+
+/* ------------------------------------------------------------ *
+ * adapt_report() prints the time spent in each rate, and the   *
+ * I2C transactions saved against a fixed 50 Hz read.           *
+ * ------------------------------------------------------------ */
+void adapt_report(struct mmc3416adapt *ad, double now) {
+   long total = 0;
+
+   ad->tinmode[ad->mode] += now - ad->tmode;
+   ad->tmode = now;
+   double runtime = now - ad->tstart;
+   for(int i=0; i<4; i++) total += ad->samples[i];
+   if(runtime <= 0 || total == 0) return;
+
+   printf("Adaptive: runtime %.1fs, %d rate switches\n", runtime, ad->switches);
+   for(int i=ad->minmode; i<4; i++) {
+      printf("Adaptive: %4.1f Hz %10.1fs (%5.1f%%) %ld samples\n", cm_hz[i],
+             ad->tinmode[i], 100 * ad->tinmode[i] / runtime, ad->samples[i]);
+   }
+   long used = i2c_xfers - ad->xfers0;
+   double fixed = runtime * cm_hz[3] * ((double) used / total);
+   printf("Adaptive: I2C transactions %ld, fixed 50 Hz estimate %.0f, saved %.0f (%.1f%%)\n",
+          used, fixed, fixed - used, (fixed > 0) ? 100 * (fixed - used) / fixed : 0);
+}
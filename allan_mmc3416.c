@@ -0,0 +1,102 @@
+/* ------------------------------------------------------------ *
+ * file:        allan_mmc3416.c                                 *
+ * purpose:     Streaming overlapping Allan deviation of the    *
+ *              X Y Z axis at octave-spaced tau = 2^k samples,  *
+ *              for noise floor and bias stability analysis.    *
+ *              With the running sum X(n) of the samples, the   *
+ *              Allan variance at tau = m samples is:           *
+ *              avar = <(X(n) - 2X(n-m) + X(n-2m))^2> / (2m^2)  *
+ *              Each tau keeps a short ring of X(n) taken every *
+ *              m/ALLAN_OVERLAP samples, so memory only grows   *
+ *              with the number of tau points, not the runtime. *
+ *              For m <= ALLAN_OVERLAP every sample is used and *
+ *              the result is the fully overlapping estimator,  *
+ *              above that successive terms overlap by 75%.     *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * allan_init() sets up ntau octave levels, tau = 1, 2, 4 ...   *
+ * ------------------------------------------------------------ */
+void allan_init(struct mmc3416allan *al, int ntau) {
+   memset(al, 0, sizeof(struct mmc3416allan));
+   al->ntau = ntau;
+   for(int k=0; k<ntau; k++) {
+      struct mmc3416avar *lv = &al->level[k];
+      lv->m = 1L << k;
+      lv->stride = (lv->m > ALLAN_OVERLAP) ? lv->m / ALLAN_OVERLAP : 1;
+      lv->lag = lv->m / lv->stride;          // ring entries per tau
+   }
+   al->enabled = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * allan_add() adds one sample: updates the running sums, and   *
+ * all tau levels that are due at this sample.                  *
+ * ------------------------------------------------------------ */
+void allan_add(struct mmc3416allan *al, struct mmc3416sample *s) {
+   float v[3] = { s->data.X, s->data.Y, s->data.Z };
+
+   if(al->count == 0) {
+      for(int a=0; a<3; a++) al->y0[a] = v[a];  // keeps X(n) small
+      al->tfirst = s->ts;
+   }
+   al->tlast = s->ts;
+   al->count++;
+   for(int a=0; a<3; a++) al->sum[a] += v[a] - al->y0[a];
+
+   for(int k=0; k<al->ntau; k++) {
+      struct mmc3416avar *lv = &al->level[k];
+      if(al->count % lv->stride != 0) continue;
+
+      /* ring holds X at n, n-stride, ..., n-2m (2*lag+1 entries) */
+      int len = 2 * lv->lag + 1;
+      for(int a=0; a<3; a++) lv->ring[a][lv->pos] = al->sum[a];
+      if(lv->fill < len) lv->fill++;
+      if(lv->fill == len) {
+         int p1 = (lv->pos - lv->lag + len) % len;
+         int p2 = (lv->pos - 2 * lv->lag + len) % len;
+         for(int a=0; a<3; a++) {
+            double d = lv->ring[a][lv->pos] - 2 * lv->ring[a][p1] + lv->ring[a][p2];
+            lv->sumsq[a] += d * d;
+         }
+         lv->terms++;
+      }
+      if(++lv->pos == len) lv->pos = 0;
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * allan_print() prints the Allan deviation table, one line per *
+ * tau with at least one term. Columns are gnuplot-friendly.    *
+ * ------------------------------------------------------------ */
+void allan_print(struct mmc3416allan *al) {
+   if(al->count < 3) {
+      printf("Error: Allan deviation needs at least 3 samples.\n");
+      return;
+   }
+   double tau0 = (al->tlast - al->tfirst) / (al->count - 1);
+
+   printf("# Allan deviation in mGauss, %ld samples, tau0 %.4fs, runtime %.1fs\n",
+          al->count, tau0, al->tlast - al->tfirst);
+   printf("# %12s %8s %10s %12s %12s %12s\n", "tau[s]", "m", "terms",
+          "adev_X", "adev_Y", "adev_Z");
+   for(int k=0; k<al->ntau; k++) {
+      struct mmc3416avar *lv = &al->level[k];
+      if(lv->terms == 0) break;
+      printf("  %12.4f %8ld %10ld", tau0 * lv->m, lv->m, lv->terms);
+      for(int a=0; a<3; a++) {
+         double avar = lv->sumsq[a] / (2.0 * lv->m * lv->m * lv->terms);
+         printf(" %12.5f", sqrt(avar));
+      }
+      printf("\n");
+   }
+}
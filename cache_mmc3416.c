@@ -0,0 +1,142 @@
+/* ------------------------------------------------------------ *
+ * file:        cache_mmc3416.c                                 *
+ * purpose:     Result sharing for concurrent -t invocations,   *
+ *              e.g. several cron jobs starting at the same     *
+ *              second. An exclusive lock on the I2C bus device *
+ *              serializes the sensor access of all users, so   *
+ *              only one process talks to the bus at a time. A  *
+ *              per-user result file keeps the last measurement *
+ *              a caller that finds a result newer than its     *
+ *              freshness window (-F) uses it, and skips the    *
+ *              bus open, probe and SET/RESET init.             *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * bus_lock() takes the exclusive lock on the I2C bus device,   *
+ * waiting up to CACHE_LOCKWAIT seconds. Everyone who may use   *
+ * the bus can take it, no shared file is involved. Returns the *
+ * locked file descriptor, or -1 if the bus stayed busy.        *
+ * ------------------------------------------------------------ */
+int bus_lock(char *i2cbus) {
+   int fd = open(i2cbus, O_RDONLY);
+   if(fd < 0) {
+      printf("Error: could not open I2C bus [%s] for locking: %s\n", i2cbus, strerror(errno));
+      return(-1);
+   }
+   double deadline = get_monotime() + CACHE_LOCKWAIT;
+   while(flock(fd, LOCK_EX | LOCK_NB) != 0) {
+      if((errno != EWOULDBLOCK && errno != EINTR) || get_monotime() > deadline) {
+         printf("Error: I2C bus [%s] is busy, no lock after %.0fs.\n", i2cbus, CACHE_LOCKWAIT);
+         close(fd);
+         return(-1);
+      }
+      struct timespec ts = { 0, 10000000 };    // poll every 10ms
+      nanosleep(&ts, NULL);
+   }
+   if(verbose == 1) printf("Debug: I2C bus [%s] locked\n", i2cbus);
+   return(fd);
+}
+
+/* ------------------------------------------------------------ *
+ * bus_unlock() releases the bus lock for the next caller.      *
+ * ------------------------------------------------------------ */
+void bus_unlock(int fd) {
+   if(fd < 0) return;
+   flock(fd, LOCK_UN);
+   close(fd);
+}
+
+/* ------------------------------------------------------------ *
+ * cache_open() opens the result file of this user and I2C bus. *
+ * It is read and written under the bus lock. Returns the file  *
+ * descriptor, or -1 if the cache can't be used (then run       *
+ * without sharing): the file belongs to another user or is     *
+ * writable by others.                                          *
+ * ------------------------------------------------------------ */
+int cache_open(char *i2cbus) {
+   char file[320];
+
+   /* /dev/i2c-1 -> /tmp/getmmc3416_<uid>_dev_i2c-1.cache */
+   int len = snprintf(file, sizeof(file), "%s/getmmc3416_%u", CACHE_DIR, (unsigned) geteuid());
+   for(char *p = i2cbus; *p != '\0' && len < (int) sizeof(file) - 8; p++) {
+      file[len++] = (*p == '/') ? '_' : *p;
+   }
+   strcpy(file + len, ".cache");
+
+   int fd = open(file, O_RDWR | O_CREAT | O_NOFOLLOW, 0644);
+   if(fd < 0) {
+      if(verbose == 1) printf("Debug: Cache [%s] not available: %s\n", file, strerror(errno));
+      return(-1);
+   }
+   struct stat st;
+   if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid()
+      || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+      if(verbose == 1) printf("Debug: Cache [%s] not trusted, check owner and mode\n", file);
+      close(fd);
+      return(-1);
+   }
+   if(verbose == 1) printf("Debug: Cache [%s] opened\n", file);
+   return(fd);
+}
+
+/* ------------------------------------------------------------ *
+ * cache_get() reads the cached result into s and b. Returns 1  *
+ * if it was taken with the same burst settings, and is not     *
+ * older than maxage seconds, else 0.                           *
+ * ------------------------------------------------------------ */
+int cache_get(int fd, double maxage, struct mmc3416burst *b, struct mmc3416sample *s) {
+   struct mmc3416cache c;
+
+   if(fd < 0 || maxage <= 0) return(0);
+   if(pread(fd, &c, sizeof(c), 0) != sizeof(c)) return(0);
+   if(memcmp(c.magic, CACHEMAGIC, sizeof(c.magic)) != 0
+      || c.version != CACHEVERSION) return(0);
+   if(c.burst.count != b->count || c.burst.outres != b->outres
+      || c.burst.target != b->target) return(0);
+
+   double age = get_time() - c.stored;
+   if(age < 0 || age > maxage) return(0);
+   if(verbose == 1) printf("Debug: Cache hit, result age %.3fs\n", age);
+   *s = c.sample;
+   *b = c.burst;
+   return(1);
+}
+
+/* ------------------------------------------------------------ *
+ * cache_put() stores a new result for the following callers.   *
+ * ------------------------------------------------------------ */
+void cache_put(int fd, struct mmc3416burst *b, struct mmc3416sample *s) {
+   struct mmc3416cache c;
+
+   if(fd < 0) return;
+   memset(&c, 0, sizeof(c));
+   memcpy(c.magic, CACHEMAGIC, sizeof(c.magic));
+   c.version = CACHEVERSION;
+   c.stored = get_time();
+   c.sample = *s;
+   c.burst = *b;
+   if(pwrite(fd, &c, sizeof(c), 0) != sizeof(c)) {
+      if(verbose == 1) printf("Debug: Cache write failed: %s\n", strerror(errno));
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * cache_close() closes the result file.                        *
+ * ------------------------------------------------------------ */
+void cache_close(int fd) {
+   if(fd >= 0) close(fd);
+}
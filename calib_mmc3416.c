@@ -0,0 +1,266 @@
+/* ------------------------------------------------------------ *
+ * file:        calib_mmc3416.c                                 *
+ * purpose:     Hard- and soft-iron calibration for the MMC3416 *
+ *              The sensor data while rotating the unit lies on *
+ *              an ellipsoid: x'Ax + 2b'x = 1. The least squares *
+ *              fit only needs the running sums D'D and D'1 of  *
+ *              the design vectors, so samples are not stored.  *
+ *              The fit yields the hard-iron bias (ellipsoid    *
+ *              center) and a 3x3 soft-iron matrix that maps    *
+ *              the ellipsoid back onto a sphere.               *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * Data is scaled to Gauss for the fit, which keeps the normal  *
+ * equations well-conditioned. Earth field is 250..650 mGauss.  *
+ * ------------------------------------------------------------ */
+#define CAL_SCALE 1000.0
+
+/* ------------------------------------------------------------ *
+ * calib_add() adds one sample to the running fit statistics.   *
+ * Costs 45 multiply-adds, only the upper triangle is updated.  *
+ * ------------------------------------------------------------ */
+void calib_add(struct mmc3416calfit *fit, struct mmc3416data *d) {
+   double x = d->X / CAL_SCALE;
+   double y = d->Y / CAL_SCALE;
+   double z = d->Z / CAL_SCALE;
+   double v[CAL_NPARAM] = { x*x, y*y, z*z, 2*y*z, 2*x*z, 2*x*y, 2*x, 2*y, 2*z };
+
+   for(int i=0; i<CAL_NPARAM; i++) {
+      for(int j=i; j<CAL_NPARAM; j++) fit->ata[i][j] += v[i] * v[j];
+      fit->atb[i] += v[i];
+   }
+   float m[3] = { d->X, d->Y, d->Z };
+   for(int i=0; i<3; i++) {
+      if(fit->count == 0 || m[i] < fit->min[i]) fit->min[i] = m[i];
+      if(fit->count == 0 || m[i] > fit->max[i]) fit->max[i] = m[i];
+   }
+   fit->count++;
+}
+
+/* ------------------------------------------------------------ *
+ * solve() Gauss elimination with partial pivoting, solves the  *
+ * n x n system a * x = b in place. Returns -1 if singular.     *
+ * ------------------------------------------------------------ */
+static int solve(int n, double a[][CAL_NPARAM], double *b) {
+   for(int c=0; c<n; c++) {
+      int p = c;
+      for(int r=c+1; r<n; r++) if(fabs(a[r][c]) > fabs(a[p][c])) p = r;
+      if(fabs(a[p][c]) < 1e-12) return(-1);
+      if(p != c) {
+         for(int k=0; k<n; k++) { double t = a[c][k]; a[c][k] = a[p][k]; a[p][k] = t; }
+         double t = b[c]; b[c] = b[p]; b[p] = t;
+      }
+      for(int r=c+1; r<n; r++) {
+         double f = a[r][c] / a[c][c];
+         for(int k=c; k<n; k++) a[r][k] -= f * a[c][k];
+         b[r] -= f * b[c];
+      }
+   }
+   for(int c=n-1; c>=0; c--) {
+      for(int k=c+1; k<n; k++) b[c] -= a[c][k] * b[k];
+      b[c] /= a[c][c];
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * eigen3() Jacobi eigen decomposition of a symmetric 3x3 a.    *
+ * Returns the eigenvalues in w, eigenvectors in the columns v. *
+ * ------------------------------------------------------------ */
+static void eigen3(double a[3][3], double w[3], double v[3][3]) {
+   double m[3][3];
+   memcpy(m, a, sizeof(m));
+   for(int i=0; i<3; i++) for(int j=0; j<3; j++) v[i][j] = (i == j);
+
+   for(int sweep=0; sweep<50; sweep++) {
+      double off = fabs(m[0][1]) + fabs(m[0][2]) + fabs(m[1][2]);
+      if(off < 1e-15) break;
+      for(int p=0; p<2; p++) {
+         for(int q=p+1; q<3; q++) {
+            if(fabs(m[p][q]) < 1e-300) continue;
+            double theta = (m[q][q] - m[p][p]) / (2 * m[p][q]);
+            double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta*theta + 1));
+            double c = 1 / sqrt(t*t + 1), s = t * c;
+            for(int k=0; k<3; k++) {       // m = m * J
+               double mkp = m[k][p], mkq = m[k][q];
+               m[k][p] = c*mkp - s*mkq;
+               m[k][q] = s*mkp + c*mkq;
+            }
+            for(int k=0; k<3; k++) {       // m = J' * m
+               double mpk = m[p][k], mqk = m[q][k];
+               m[p][k] = c*mpk - s*mqk;
+               m[q][k] = s*mpk + c*mqk;
+            }
+            for(int k=0; k<3; k++) {       // v = v * J
+               double vkp = v[k][p], vkq = v[k][q];
+               v[k][p] = c*vkp - s*vkq;
+               v[k][q] = s*vkp + c*vkq;
+            }
+         }
+      }
+   }
+   for(int i=0; i<3; i++) w[i] = m[i][i];
+}
+
+/* ------------------------------------------------------------ *
+ * calib_solve() fits the ellipsoid from the collected sums and *
+ * derives bias and soft-iron matrix. The corrected field keeps *
+ * the mean field strength. Returns 0 on success, -1 if the fit *
+ * is not an ellipsoid (typically not enough rotation coverage) *
+ * ------------------------------------------------------------ */
+int calib_solve(struct mmc3416calfit *fit, struct mmc3416cal *cal) {
+   double a[CAL_NPARAM][CAL_NPARAM];
+   double p[CAL_NPARAM];
+
+   if(fit->count < 3 * CAL_NPARAM) {
+      printf("Error: calibration needs more samples, got %ld.\n", fit->count);
+      return(-1);
+   }
+   for(int i=0; i<CAL_NPARAM; i++) {
+      for(int j=0; j<CAL_NPARAM; j++) a[i][j] = (j >= i) ? fit->ata[i][j] : fit->ata[j][i];
+      p[i] = fit->atb[i];
+   }
+   if(solve(CAL_NPARAM, a, p) != 0) {
+      printf("Error: calibration fit is singular, rotate the unit through all axes.\n");
+      return(-1);
+   }
+
+   /* ---------------------------------------------------------- *
+    * algebraic residual from the sums: p'(D'D)p - 2p'(D'1) + n  *
+    * ---------------------------------------------------------- */
+   double res = fit->count;
+   for(int i=0; i<CAL_NPARAM; i++) {
+      res -= 2 * p[i] * fit->atb[i];
+      for(int j=0; j<CAL_NPARAM; j++) {
+         res += p[i] * p[j] * ((j >= i) ? fit->ata[i][j] : fit->ata[j][i]);
+      }
+   }
+   cal->residual = sqrt(fabs(res) / fit->count);
+
+   /* ---------------------------------------------------------- *
+    * Ellipsoid center c = -A^-1 b is the hard-iron bias         *
+    * ---------------------------------------------------------- */
+   double A[3][3] = { { p[0], p[5], p[4] },
+                      { p[5], p[1], p[3] },
+                      { p[4], p[3], p[2] } };
+   double m[CAL_NPARAM][CAL_NPARAM];
+   double c[3] = { -p[6], -p[7], -p[8] };
+   for(int i=0; i<3; i++) for(int j=0; j<3; j++) m[i][j] = A[i][j];
+   if(solve(3, m, c) != 0) {
+      printf("Error: calibration fit has no center, rotate the unit through all axes.\n");
+      return(-1);
+   }
+   double k = 1;
+   for(int i=0; i<3; i++) for(int j=0; j<3; j++) k += c[i] * A[i][j] * c[j];
+
+   /* ---------------------------------------------------------- *
+    * (x-c)'(A/k)(x-c) = 1, soft-iron matrix W = sqrt(A/k)       *
+    * ---------------------------------------------------------- */
+   double w[3], v[3][3];
+   for(int i=0; i<3; i++) for(int j=0; j<3; j++) A[i][j] /= k;
+   eigen3(A, w, v);
+   if(w[0] <= 0 || w[1] <= 0 || w[2] <= 0) {
+      printf("Error: calibration fit is no ellipsoid, rotate the unit through all axes.\n");
+      return(-1);
+   }
+   double radius = pow(w[0] * w[1] * w[2], -1.0 / 6);  // geometric mean radius
+
+   for(int i=0; i<3; i++) {
+      cal->bias[i] = (float) (c[i] * CAL_SCALE);
+      for(int j=0; j<3; j++) {
+         double sum = 0;
+         for(int e=0; e<3; e++) sum += v[i][e] * sqrt(w[e]) * v[j][e];
+         cal->matrix[i][j] = (float) (sum * radius);
+      }
+   }
+   cal->radius = (float) (radius * CAL_SCALE);
+   cal->valid = 1;
+
+   if(verbose == 1) {
+      printf("Debug: Calibration samples %ld, span X-[%3.02f] Y-[%3.02f] Z-[%3.02f]\n",
+             fit->count, fit->max[0] - fit->min[0], fit->max[1] - fit->min[1],
+             fit->max[2] - fit->min[2]);
+      printf("Debug: Calibration axis radius [%3.02f] [%3.02f] [%3.02f]\n",
+             CAL_SCALE / sqrt(w[0]), CAL_SCALE / sqrt(w[1]), CAL_SCALE / sqrt(w[2]));
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * calib_apply() corrects the sample data: M * (v - bias). Adds *
+ * 3 subtractions and 9 multiply-adds per sample.               *
+ * ------------------------------------------------------------ */
+void calib_apply(struct mmc3416cal *cal, struct mmc3416data *d) {
+   float x = d->X - cal->bias[0];
+   float y = d->Y - cal->bias[1];
+   float z = d->Z - cal->bias[2];
+   d->X = cal->matrix[0][0] * x + cal->matrix[0][1] * y + cal->matrix[0][2] * z;
+   d->Y = cal->matrix[1][0] * x + cal->matrix[1][1] * y + cal->matrix[1][2] * z;
+   d->Z = cal->matrix[2][0] * x + cal->matrix[2][1] * y + cal->matrix[2][2] * z;
+}
+
+/* ------------------------------------------------------------ *
+ * calib_save() writes the calibration as text file, format:    *
+ * bias bx by bz / matrix m00 m01 m02 (3 lines) / radius r      *
+ * ------------------------------------------------------------ */
+int calib_save(char *file, struct mmc3416cal *cal) {
+   FILE *fp = fopen(file, "w");
+   if(fp == NULL) {
+      printf("Error: could not create calibration file [%s].\n", file);
+      return(-1);
+   }
+   fprintf(fp, "# MMC3416 hard- and soft-iron calibration\n");
+   fprintf(fp, "bias %f %f %f\n", cal->bias[0], cal->bias[1], cal->bias[2]);
+   for(int i=0; i<3; i++) {
+      fprintf(fp, "matrix %f %f %f\n", cal->matrix[i][0], cal->matrix[i][1], cal->matrix[i][2]);
+   }
+   fprintf(fp, "radius %f\n", cal->radius);
+   fprintf(fp, "residual %f\n", cal->residual);
+   if(fclose(fp) != 0) {
+      printf("Error: could not write calibration file [%s].\n", file);
+      return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * calib_load() reads a calibration file from calib_save().     *
+ * ------------------------------------------------------------ */
+int calib_load(char *file, struct mmc3416cal *cal) {
+   char line[256];
+   int nbias = 0, nmatrix = 0;
+
+   FILE *fp = fopen(file, "r");
+   if(fp == NULL) {
+      printf("Error: could not open calibration file [%s].\n", file);
+      return(-1);
+   }
+   memset(cal, 0, sizeof(struct mmc3416cal));
+   while(fgets(line, sizeof(line), fp) != NULL) {
+      if(line[0] == '#') continue;
+      if(sscanf(line, "bias %f %f %f", &cal->bias[0], &cal->bias[1], &cal->bias[2]) == 3) nbias++;
+      else if(nmatrix < 3 && sscanf(line, "matrix %f %f %f", &cal->matrix[nmatrix][0],
+              &cal->matrix[nmatrix][1], &cal->matrix[nmatrix][2]) == 3) nmatrix++;
+      else if(sscanf(line, "radius %f", &cal->radius) == 1) continue;
+      else if(sscanf(line, "residual %f", &cal->residual) == 1) continue;
+   }
+   fclose(fp);
+   if(nbias != 1 || nmatrix != 3) {
+      printf("Error: invalid calibration file [%s].\n", file);
+      return(-1);
+   }
+   cal->valid = 1;
+   if(verbose == 1) printf("Debug: Calibration bias X-[%3.02f] Y-[%3.02f] Z-[%3.02f]\n",
+                            cal->bias[0], cal->bias[1], cal->bias[2]);
+   return(0);
+}
@@ -0,0 +1,121 @@
+/* ------------------------------------------------------------ *
+ * file:        config_mmc3416.c                                *
+ * purpose:     Configuration file for live reconfiguration of  *
+ *              a running continuous read. The file is read at  *
+ *              the start, and again on SIGHUP. It is parsed    *
+ *              and checked as a whole into a new config, so a  *
+ *              broken file never leaves a half-applied change. *
+ *              Settings missing from the file stay unchanged.  *
+ *              Example file:                                   *
+ *                 # getmmc3416 -c 3 -C ./mmc3416.conf          *
+ *                 freq = 3                                     *
+ *                 resolution = 16                              *
+ *                 declination = 7.73                           *
+ *                 filter = med:5,cic:25                        *
+ *                 output = csv:/var/log/mmc3416.csv            *
+ *                 output = /var/www/html/mmc3416.html@avg:50   *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * outres_parse() converts the -m resolution argument 12/14/16  *
+ * or 16h into the control-1 register BW bits, -1 on errors.    *
+ * ------------------------------------------------------------ */
+int outres_parse(char *arg) {
+   if(strcmp(arg, "16h") == 0) return(0x00);   // 16 bit, 7.92ms read time
+   if(strcmp(arg, "16") == 0)  return(0x01);   // 16 bit, 4.08ms read time
+   if(strcmp(arg, "14") == 0)  return(0x02);   // 14 bit, 2.16ms read time
+   if(strcmp(arg, "12") == 0)  return(0x03);   // 12 bit, 1.20ms read time
+   return(-1);
+}
+
+/* ------------------------------------------------------------ *
+ * trim() removes leading and trailing white space in place.    *
+ * ------------------------------------------------------------ */
+static char *trim(char *p) {
+   while(isspace((unsigned char) *p)) p++;
+   char *end = p + strlen(p);
+   while(end > p && isspace((unsigned char) end[-1])) *--end = '\0';
+   return(p);
+}
+
+/* ------------------------------------------------------------ *
+ * config_load() reads "key = value" lines into conf. Keys are  *
+ * freq, resolution, declination, filter and output. "output"   *
+ * lines replace the whole -o output list, "none" clears the    *
+ * filter or outputs. The file is parsed into a separate config *
+ * that is copied to conf only if all lines are valid, else -1  *
+ * is returned with conf unchanged.                             *
+ * ------------------------------------------------------------ */
+int config_load(char *file, struct mmc3416conf *conf) {
+   static struct mmc3416conf parsed; // large (sink buffers), not on the stack
+   struct mmc3416conf *cf = &parsed;
+   char line[512], *end;
+   int lineno = 0, err = 0;
+
+   FILE *fp = fopen(file, "r");
+   if(fp == NULL) {
+      printf("Error: could not open config file [%s].\n", file);
+      return(-1);
+   }
+   memset(cf, 0, sizeof(struct mmc3416conf));
+   cf->cmfreq = -1;
+   cf->outres = -1;
+
+   while(err == 0 && fgets(line, sizeof(line), fp) != NULL) {
+      lineno++;
+      char *key = trim(line);
+      if(key[0] == '#' || key[0] == '\0') continue;
+      char *val = strchr(key, '=');
+      if(val == NULL) { err = 1; break; }
+      *val++ = '\0';
+      key = trim(key);
+      val = trim(val);
+
+      if(strcmp(key, "freq") == 0) {
+         cf->cmfreq = (int) strtol(val, &end, 10);
+         if(end == val || *end != '\0' || cf->cmfreq < 0 || cf->cmfreq > 3) err = 1;
+      }
+      else if(strcmp(key, "resolution") == 0) {
+         if((cf->outres = outres_parse(val)) < 0) err = 1;
+      }
+      else if(strcmp(key, "declination") == 0) {
+         cf->declination = strtof(val, &end);
+         if(end == val || *end != '\0' || cf->declination < -30.0 || cf->declination > 30.0) err = 1;
+         cf->havedecl = 1;
+      }
+      else if(strcmp(key, "filter") == 0) {
+         if(strlen(val) >= sizeof(cf->filterspec)) err = 1;
+         else if(strcmp(val, "none") != 0 && filter_parse(val, &cf->filter) != 0) err = 1;
+         else strcpy(cf->filterspec, val);
+         cf->havefilter = 1;
+      }
+      else if(strcmp(key, "output") == 0) {
+         cf->haveoutput = 1;
+         if(strcmp(val, "none") == 0) continue;
+         if(cf->nsink == MAXSINK) {
+            printf("Error: too many outputs, max %d.\n", MAXSINK);
+            err = 1;
+         }
+         else if(sink_parse(val, &cf->sink[cf->nsink]) != 0) err = 1;
+         else cf->nsink++;
+      }
+      else err = 1;
+   }
+   fclose(fp);
+   if(err != 0) {
+      printf("Error: invalid config file [%s] line %d.\n", file, lineno);
+      return(-1);
+   }
+   *conf = parsed;
+   if(verbose == 1) printf("Debug: Config [%s] loaded, %d lines\n", file, lineno);
+   return(0);
+}
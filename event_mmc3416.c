@@ -0,0 +1,197 @@
+/* ------------------------------------------------------------ *
+ * file:        event_mmc3416.c                                 *
+ * purpose:     On-line change-point detection for the MMC3416  *
+ *              sample stream, e.g. for vehicle or door-open    *
+ *              detection. A slow baseline tracks the X Y Z and *
+ *              field magnitude, the largest deviation from it  *
+ *              feeds a one-sided CUSUM. Crossing the threshold *
+ *              starts an event, the event ends after the CUSUM *
+ *              stays below half the threshold for hold secs.   *
+ *              Events are printed, can run a command, or get   *
+ *              written into a FIFO. State is O(1) per sensor.  *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "mmc3416.h"
+
+#define EVENT_TAU     30.0  // baseline time constant in seconds
+#define EVENT_WARMUP   1.0  // seconds of data before detection starts
+
+/* ------------------------------------------------------------ *
+ * event_parse() reads the -e spec "k:h[:hold]": the drift      *
+ * allowance k and CUSUM threshold h in mGauss, and the quiet   *
+ * time in seconds that ends an event (default 1s).             *
+ * ------------------------------------------------------------ */
+int event_parse(char *spec, struct mmc3416event *ev) {
+   ev->hold = 1;
+   int n = sscanf(spec, "%f:%f:%f", &ev->k, &ev->h, &ev->hold);
+   if(n < 2 || ev->k < 0 || ev->h <= 0 || ev->hold <= 0) return(-1);
+   ev->enabled = 1;
+   ev->fifofd = -1;
+   ev->latmin = 1e9;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * event_fifo() writes the event line into the FIFO. The FIFO   *
+ * is opened non-blocking, events are dropped while no reader   *
+ * is attached, so a missing reader never stalls acquisition.   *
+ * ------------------------------------------------------------ */
+static void event_fifo(struct mmc3416event *ev, char *line, int len) {
+   if(ev->fifofd < 0) {
+      ev->fifofd = open(ev->fifo, O_WRONLY | O_NONBLOCK);
+      if(ev->fifofd < 0) {
+         if(verbose == 1) printf("Debug: Event FIFO [%s] has no reader\n", ev->fifo);
+         return;
+      }
+   }
+   if(write(ev->fifofd, line, len) != len) {
+      if(verbose == 1) printf("Debug: Event FIFO write failed: %s\n", strerror(errno));
+      if(errno == EPIPE) { close(ev->fifofd); ev->fifofd = -1; }
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * event_exec() starts the event command in the background, the *
+ * event details are passed in MMC3416_EVENT, MMC3416_TS and    *
+ * MMC3416_DEV environment variables.                           *
+ * ------------------------------------------------------------ */
+static void event_exec(struct mmc3416event *ev, char *type, double ts, float dev) {
+   char buf[32];
+
+   while(waitpid(-1, NULL, WNOHANG) > 0);  // reap finished commands
+   pid_t pid = fork();
+   if(pid < 0) {
+      printf("Error: could not start event command: %s\n", strerror(errno));
+      return;
+   }
+   if(pid == 0) {
+      setenv("MMC3416_EVENT", type, 1);
+      snprintf(buf, sizeof(buf), "%.3f", ts);
+      setenv("MMC3416_TS", buf, 1);
+      snprintf(buf, sizeof(buf), "%.2f", dev);
+      setenv("MMC3416_DEV", buf, 1);
+      execl("/bin/sh", "sh", "-c", ev->cmd, (char *) NULL);
+      _exit(127);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * event_emit() sends the event to all targets and records the  *
+ * latency from the triggering I2C read to the event emission.  *
+ * ------------------------------------------------------------ */
+static void event_emit(struct mmc3416event *ev, struct mmc3416sample *s,
+                       char *type, float dev) {
+   char line[256];
+   int len;
+
+   if(type[0] == 's') {
+      float mag = sqrtf(s->data.X * s->data.X + s->data.Y * s->data.Y
+                      + s->data.Z * s->data.Z);
+      len = snprintf(line, sizeof(line), "%.3f Event=start Dev=%.2f F=%.2f\n",
+                     s->ts, dev, mag);
+   }
+   else {
+      len = snprintf(line, sizeof(line), "%.3f Event=end Duration=%.3fs Peak=%.2f\n",
+                     s->ts, s->ts - ev->tstart, ev->peak);
+   }
+   fputs(line, stdout);
+   fflush(stdout);
+   if(ev->fifo[0] != '\0') event_fifo(ev, line, len);
+   if(ev->cmd[0] != '\0') event_exec(ev, type, s->ts, dev);
+
+   double lat = get_monotime() - s->tread;
+   if(lat < ev->latmin) ev->latmin = lat;
+   if(lat > ev->latmax) ev->latmax = lat;
+   ev->latsum += lat;
+   ev->emitted++;
+}
+
+/* ------------------------------------------------------------ *
+ * event_update() runs the detector on a calibrated sample.     *
+ * ------------------------------------------------------------ */
+void event_update(struct mmc3416event *ev, struct mmc3416sample *s) {
+   float v[4] = { s->data.X, s->data.Y, s->data.Z, 0 };
+   v[3] = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+
+   if(ev->count++ == 0) {
+      for(int i=0; i<4; i++) ev->base[i] = v[i];
+      ev->tfirst = s->ts;
+      ev->tlast = s->ts;
+      return;
+   }
+   double dt = s->ts - ev->tlast;
+   ev->tlast = s->ts;
+
+   /* ---------------------------------------------------------- *
+    * largest deviation of any axis or the magnitude             *
+    * ---------------------------------------------------------- */
+   float dev = 0;
+   for(int i=0; i<4; i++) {
+      float d = fabsf(v[i] - ev->base[i]);
+      if(d > dev) dev = d;
+   }
+
+   if(ev->active == 0) {
+      /* baseline follows slow drift only outside of events */
+      double alpha = (dt > 0) ? dt / (EVENT_TAU + dt) : 0;
+      for(int i=0; i<4; i++) ev->base[i] += alpha * (v[i] - ev->base[i]);
+      if(s->ts - ev->tfirst < EVENT_WARMUP) return;
+
+      ev->cusum += dev - ev->k;
+      if(ev->cusum < 0) ev->cusum = 0;
+      if(ev->cusum > ev->h) {
+         ev->active = 1;
+         ev->tstart = s->ts;
+         ev->tquiet = s->ts;
+         ev->peak = dev;
+         ev->events++;
+         event_emit(ev, s, "start", dev);
+      }
+      return;
+   }
+
+   /* ---------------------------------------------------------- *
+    * inside an event the CUSUM is capped at h, the event ends   *
+    * after it stayed below h/2 for hold seconds. Single noise   *
+    * samples above k do not restart the hold time.              *
+    * ---------------------------------------------------------- */
+   if(dev > ev->peak) ev->peak = dev;
+   ev->cusum += dev - ev->k;
+   if(ev->cusum < 0) ev->cusum = 0;
+   if(ev->cusum > ev->h) ev->cusum = ev->h;
+   if(ev->cusum > ev->h / 2) ev->tquiet = s->ts;
+   else if(s->ts - ev->tquiet >= ev->hold) {
+      event_emit(ev, s, "end", dev);
+      ev->active = 0;
+      ev->cusum = 0;
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * event_report() prints the event count and emission latency  *
+ * ------------------------------------------------------------ */
+void event_report(struct mmc3416event *ev) {
+   if(ev->fifofd >= 0) close(ev->fifofd);
+   ev->fifofd = -1;
+   while(waitpid(-1, NULL, WNOHANG) > 0);
+   if(ev->emitted == 0) {
+      printf("Events: 0 events in %ld samples\n", ev->count);
+      return;
+   }
+   printf("Events: %ld events in %ld samples, read to emit latency"
+          " min %.3fms avg %.3fms max %.3fms\n", ev->events, ev->count,
+          ev->latmin * 1000, ev->latsum / ev->emitted * 1000, ev->latmax * 1000);
+}
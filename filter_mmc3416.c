@@ -0,0 +1,209 @@
+/* ------------------------------------------------------------ *
+ * file:        filter_mmc3416.c                                *
+ * purpose:     Streaming digital filters for MMC3416 samples.  *
+ *              Filters work on the X Y Z field vector, so the  *
+ *              heading computed afterwards is not affected by  *
+ *              the 0/360 degree wraparound. All filter state   *
+ *              is preallocated in struct mmc3416filter, there  *
+ *              is no memory allocation in the sample path.     *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * filters:     avg:N    moving average over N samples          *
+ *              iir:A    1st order low-pass, y += A * (x - y)   *
+ *              med:N    moving median over N samples           *
+ *              cic:R[:N] CIC decimator by R, order N (def. 3)  *
+ *              Stages are chained with ',' e.g. med:5,cic:10   *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * CIC integer scale: 1/1024 milli Gauss keeps the integrators  *
+ * exact, so they never drift even on runs lasting for weeks.   *
+ * ------------------------------------------------------------ */
+#define CIC_SCALE 1024.0
+
+/* ------------------------------------------------------------ *
+ * filter_parse() converts a filter spec string into a filter   *
+ * chain, returns 0 on success and -1 for an invalid spec.      *
+ * ------------------------------------------------------------ */
+int filter_parse(char *spec, struct mmc3416filter *f) {
+   char buf[256];
+   char *tok, *save, *end;
+   long n;
+
+   memset(f, 0, sizeof(struct mmc3416filter));
+   if(strlen(spec) >= sizeof(buf)) return(-1);
+   strncpy(buf, spec, sizeof(buf));
+
+   for(tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+      if(f->nstage == FILTER_MAXSTAGE) {
+         printf("Error: filter chain is limited to %d stages.\n", FILTER_MAXSTAGE);
+         return(-1);
+      }
+      struct mmc3416stage *st = &f->stage[f->nstage];
+      char *arg = strchr(tok, ':');
+      if(arg == NULL) {
+         printf("Error: filter [%s] needs an argument, e.g. avg:10.\n", tok);
+         return(-1);
+      }
+      *arg++ = '\0';
+
+      if(strcmp(tok, "avg") == 0 || strcmp(tok, "med") == 0) {
+         st->type = (tok[0] == 'a') ? FILTER_AVG : FILTER_MED;
+         n = strtol(arg, &end, 10);
+         if(end == arg || *end != '\0' || n < 1 || n > FILTER_MAXWIN) {
+            printf("Error: filter %s window must be 1..%d.\n", tok, FILTER_MAXWIN);
+            return(-1);
+         }
+         st->len = (int) n;
+      }
+      else if(strcmp(tok, "iir") == 0) {
+         st->type = FILTER_IIR;
+         st->alpha = strtod(arg, &end);
+         if(end == arg || *end != '\0' || !(st->alpha > 0 && st->alpha <= 1)) {
+            printf("Error: filter iir factor must be 0 < A <= 1.\n");
+            return(-1);
+         }
+      }
+      else if(strcmp(tok, "cic") == 0) {
+         st->type = FILTER_CIC;
+         n = strtol(arg, &end, 10);
+         if(end == arg || (*end != '\0' && *end != ':') || n < 2 || n > FILTER_MAXWIN) {
+            printf("Error: filter cic decimation must be 2..%d.\n", FILTER_MAXWIN);
+            return(-1);
+         }
+         st->len = (int) n;
+         st->order = 3;
+         if(*end == ':') {
+            char *ord = end + 1;
+            n = strtol(ord, &end, 10);
+            if(end == ord || *end != '\0' || n < 1 || n > FILTER_MAXCIC) {
+               printf("Error: filter cic order must be 1..%d.\n", FILTER_MAXCIC);
+               return(-1);
+            }
+            st->order = (int) n;
+         }
+         st->gain = 1.0;
+         for(int i=0; i<st->order; i++) st->gain *= st->len;
+      }
+      else {
+         printf("Error: unknown filter type [%s].\n", tok);
+         return(-1);
+      }
+      if(verbose == 1) printf("Debug: Filter stage %d: %s:%s\n", f->nstage, tok, arg);
+      f->nstage++;
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * median_update() replaces the oldest window value in the      *
+ * sorted array with the new one. The window is limited to      *
+ * FILTER_MAXWIN, which bounds the cost per sample.             *
+ * ------------------------------------------------------------ */
+static float median_update(float *sorted, int n, float old, int full, float new) {
+   int i;
+   if(full) {                      // remove the oldest value
+      for(i=0; i<n && sorted[i] != old; i++);
+      if(i < n) {
+         memmove(&sorted[i], &sorted[i+1], (n-i-1) * sizeof(float));
+         n--;
+      }
+   }
+   for(i=n; i>0 && sorted[i-1] > new; i--) sorted[i] = sorted[i-1];
+   sorted[i] = new;
+   n++;
+   if(n & 1) return sorted[n/2];
+   return (sorted[n/2-1] + sorted[n/2]) / 2;
+}
+
+/* ------------------------------------------------------------ *
+ * stage_run() pushes one vector through a single filter stage. *
+ * Returns 1 if the stage produced an output, 0 if the sample   *
+ * was absorbed by decimation.                                  *
+ * ------------------------------------------------------------ */
+static int stage_run(struct mmc3416stage *st, float v[3]) {
+   int full, out = 1;
+
+   switch(st->type) {
+      case FILTER_AVG:
+         full = (st->count == st->len);
+         for(int a=0; a<3; a++) {
+            if(full) st->sum[a] -= st->ring[a][st->pos];
+            st->ring[a][st->pos] = v[a];
+            st->sum[a] += v[a];
+            v[a] = st->sum[a] / (full ? st->len : st->count + 1);
+         }
+         if(!full) st->count++;
+         if(++st->pos == st->len) st->pos = 0;
+         break;
+
+      case FILTER_IIR:
+         if(st->count == 0) {      // start from the first sample
+            for(int a=0; a<3; a++) st->y[a] = v[a];
+            st->count = 1;
+         }
+         for(int a=0; a<3; a++) {
+            st->y[a] += st->alpha * (v[a] - st->y[a]);
+            v[a] = st->y[a];
+         }
+         break;
+
+      case FILTER_MED:
+         full = (st->count == st->len);
+         for(int a=0; a<3; a++) {
+            float old = st->ring[a][st->pos];
+            st->ring[a][st->pos] = v[a];
+            v[a] = median_update(st->sorted[a], st->count, old, full, v[a]);
+         }
+         if(!full) st->count++;
+         if(++st->pos == st->len) st->pos = 0;
+         break;
+
+      case FILTER_CIC:
+         for(int a=0; a<3; a++) {
+            /* integrators run at the input rate, wrap is harmless */
+            uint64_t x = (uint64_t) (int64_t) (v[a] * CIC_SCALE);
+            for(int i=0; i<st->order; i++) {
+               st->integ[a][i] += x;
+               x = st->integ[a][i];
+            }
+         }
+         if(++st->count < st->len) return(0);
+         st->count = 0;
+         for(int a=0; a<3; a++) {
+            /* combs run at the output rate */
+            uint64_t y = st->integ[a][st->order-1];
+            for(int i=0; i<st->order; i++) {
+               uint64_t prev = st->comb[a][i];
+               st->comb[a][i] = y;
+               y -= prev;
+            }
+            v[a] = (float) ((double) (int64_t) y / st->gain / CIC_SCALE);
+         }
+         /* the first outputs are still filling the comb delay */
+         if(st->primed < st->order) { st->primed++; out = 0; }
+         break;
+   }
+   return(out);
+}
+
+/* ------------------------------------------------------------ *
+ * filter_run() runs the sample data through the filter chain.  *
+ * Returns 1 if filtered data is ready for output, 0 otherwise. *
+ * ------------------------------------------------------------ */
+int filter_run(struct mmc3416filter *f, struct mmc3416data *d) {
+   float v[3] = { d->X, d->Y, d->Z };
+
+   for(int i=0; i<f->nstage; i++) {
+      if(stage_run(&f->stage[i], v) == 0) return(0);
+   }
+   d->X = v[0]; d->Y = v[1]; d->Z = v[2];
+   return(1);
+}
@@ -7,7 +7,7 @@
  *                                                              *
  * requires:	I2C headers, e.g. sudo apt install libi2c-dev   *
  *                                                              *
- * compile:	gcc -o getmmc3416 i2c_mmc3416.c getmmc3416.c    *
+ * compile:	make (see Makefile for the list of source files) *
  *                                                              *
  * example:	./getmmc3416 -t -o mmc3416.htm                  *
  *                                                              *
@@ -19,67 +19,191 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 #include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include "mmc3416.h"
 
 /* ------------------------------------------------------------ *
  * Global variables and defaults                                *
  * ------------------------------------------------------------ */
 int verbose = 0;
-int outflag = 0;
 int argflag = 0;          // 1=dump, 2=info, 3=reset, 4=data, 5=continuous
-                          // 6=set_ cont_read_freq
+                          // 6=set_ cont_read_freq, 7=replay, 8=ring dump
 int cm_status = 0;        // continuous read mode enabler on/off
 int cmfreq_mode = 0;      // continuous read frequency mode setting
 int noboost_status = 0;   // No Boost CAP setting
 int outres_mode = 0;      // output resolution mode
-char outres_set[4] = {0}; // set output resolution mode value
+int outres_set = -1;      // set output resolution mode, -1 = keep
 char status[7]    = {0};  // device status
 char i2c_bus[256] = I2CBUS;
-char htmfile[256] = {0};
+char recfile[256] = {0};  // record raw samples to this file
+#define MAXREPLAY 256     // max number of replay files
+char *playfile[MAXREPLAY];// recordings to replay
+int playcount = 0;        // number of replay files
+int playpace = 0;         // 0 = replay fast, 1 = at recorded pace
+int playjobs = 0;         // parallel replay workers, 0 = CPU count
+volatile sig_atomic_t stopflag = 0; // set by SIGINT/SIGTERM
+struct mmc3416filter outfilter;       // filter chain for stdout output
+char filterspec[256] = {0};           // -f filter chain spec
+struct mmc3416cal cal;                // hard/soft-iron calibration
+struct mmc3416calfit calfit;          // calibration fit statistics
+char calfile[256] = {0};              // -K calibration output file
+struct mmc3416rollup rollup[MAXROLLUP]; // -s rollup windows
+int rollcount = 0;                    // number of rollup windows
+struct mmc3416adapt adapt;            // -a adaptive read frequency
+struct mmc3416event event;            // -e change-point detector
+struct mmc3416allan allan;            // -A Allan deviation analysis
+struct mmc3416spec spec;              // -S spectral analysis
+struct mmc3416sink sink[MAXSINK];     // -o output sinks
+int sinkcount = 0;                    // number of output sinks
+int sinkstdout = 0;                   // 1 = a sink replaces stdout text
+char conffile[256] = {0};             // -C live configuration file
+struct mmc3416conf conf;              // -C configuration, as last read
+volatile sig_atomic_t reloadflag = 0; // set by SIGHUP
+struct mmc3416burst burst;            // -n burst oversampling for -t
+double cacheage = 0;                  // -F max age of a shared -t result
+char ringfile[256] = {0};             // -W flight recorder ring file
+uint32_t ringslots = RING_SLOTS;      // -W number of ring records
+struct mmc3416ring ring;              // -W mapped flight recorder ring
 
 /* ------------------------------------------------------------ *
  * print_usage() prints the programs commandline instructions.  *
  * ------------------------------------------------------------ */
 void usage() {
-   static char const usage[] = "Usage: getmmc3416 [-b i2c-bus] [-c 0..3] [-d] [-i] [-m mode] [-t] [-l decl] [-r] [-o htmlfile] [-v]\n\
+   static char const usage[] = "Usage: getmmc3416 [-a up:down:quiet] [-A] [-b i2c-bus] [-c 0..3] [-C conffile] [-d] [-e k:h:hold] [-E fifo] [-x cmd] [-i] [-m mode] [-t [-n count] [-N stderr] [-F secs]] [-l decl] [-r] [-o [type:]file[@filter]] [-f filter] [-k|-K calfile] [-p file] [-s secs] [-S freqs] [-v] [-W file[:records]] [-X file]\n\
 \n\
 Command line parameters have the following format:\n\
+   -a   adaptive read frequency (requires -c). Switches to 50 Hz when the\n\
+        field changes faster than 'up' mGauss/s, and steps down one rate\n\
+        after 'quiet' seconds below 'down' mGauss/s, until the -c rate.\n\
+        The rate of change is measured over 0.5s, to average out the noise.\n\
+        Defaults: down = up/2, quiet = 5s. example: -a 200:100:10\n\
+   -A   noise characterization (requires -c/-p). Computes the overlapping\n\
+        Allan deviation of each axis at octave-spaced tau values, and\n\
+        prints the table at the end instead of each sample.\n\
    -b   I2C bus to query, Example: -b /dev/i2c-1 (default)\n\
    -c   start continuous read with a given frequency 0..3. examples:\n\
              -c 0 = read at 1.5 Hz (1 sample every 1.5 seconds - default)\n\
              -c 1 = read at 13 Hz (1 sample every 77 milliseconds)\n\
              -c 2 = read at 25 Hz (1 sample every 40 milliseconds)\n\
              -c 3 = read at 50 Hz (1 sample every 20 milliseconds)\n\
+   -C   config file for live changes (requires -c), read at the start and\n\
+        again on SIGHUP. Lines 'key = value' with the keys freq (0..3),\n\
+        resolution (see -m), declination, filter (see -f) and output (see\n\
+        -o, repeatable). Changes apply between two samples, and only the\n\
+        changed sensor registers are written. example: -C ./mmc3416.conf\n\
    -d   dump the complete sensor register map content\n\
+   -e   detect events on the field (requires -c/-p), e.g. a vehicle passing.\n\
+        The deviation from a slow baseline feeds a CUSUM with the drift\n\
+        allowance 'k' mGauss, and starts an event when it exceeds 'h'. The\n\
+        event ends after 'hold' seconds below h/2 (default 1s). Events are\n\
+        printed with timestamp, example: -e 5:50:2\n\
+   -E   also write event records into this FIFO (requires -e), the FIFO\n\
+        needs to exist (mkfifo), example: -E /tmp/mmc3416.fifo\n\
+   -f   filter chain for the data output (requires -c/-p), stages are\n\
+        separated by ',' and run in the given order:\n\
+             avg:N    = moving average over N samples (N=1..64)\n\
+             iir:A    = 1st order low-pass, y += A * (x - y) (0<A<=1)\n\
+             med:N    = moving median over N samples, spike rejection\n\
+             cic:R[:N]= CIC decimation by R (2..64), order N (1..4, def. 3)\n\
+        example: -f med:5,cic:25 turns 50 Hz samples into a 2 Hz output\n\
+   -F   share -t results (requires -t): a result of another -t call that is\n\
+        at most 'secs' old is used without any bus access. Concurrent -t\n\
+        calls wait up to 10s on a lock of the bus device, so only one accesses\n\
+        the sensor. Results are shared between the processes of one user\n\
+        in /tmp/getmmc3416_<uid>_<bus>.cache. example: -F 2\n\
    -i   print sensor information\n\
+   -j   number of parallel replay workers (requires -p), default: CPU count\n\
+   -k   apply hard- and soft-iron calibration from file (requires -t/-c/-p),\n\
+        example: -k ./cal.txt\n\
+   -K   calibrate: collect data while the unit is rotated through all axes,\n\
+        fit the ellipsoid at the end (ctrl-c), and save the calibration\n\
+        file (requires -c, or -p with one file), example: -K ./cal.txt\n\
    -l   local declination offset value (requires -t/-c), example: -l 7.73\n\
         see http://www.ngdc.noaa.gov/geomag-web/#declination\n\
-   -m   set sensor output resolution mode. arguments: 12/14/16/16h. examples:\n\
+   -m   set sensor output resolution mode (requires -t/-c). arguments:\n\
+        12/14/16/16h. examples:\n\
              -m 12   = output resolution 12 bit (1.20ms read time)\n\
              -m 14   = output resolution 14 bit (2.16ms read time)\n\
              -m 16   = output resolution 16 bit (4.08ms read time)\n\
              -m 16h  = output resolution 16 bit (7.92ms read time)\n\
+   -n   burst oversampling (requires -t): average 'count' (2..1024) triggered\n\
+        measurements, taken back to back with the next trigger overlapping\n\
+        the previous data read. Prints the standard error and wall time.\n\
+   -N   noise target in mGauss for the -n burst standard error. Without -m,\n\
+        the burst uses the fastest resolution that meets it. example: -N 0.1\n\
+   -p   replay raw samples from a recording file instead of the sensor.\n\
+        Repeat -p to process several files in parallel, the output of\n\
+        each file then goes to <file>.out. example: -p ./day1.csv\n\
    -r   reset sensor\n\
+   -R   replay at the recorded pace (requires -p), default: fast as possible\n\
+   -s   rollup window length(s) in seconds, up to 4 separated by ',' (requires\n\
+        -c/-p). Instead of each sample, one record per window is printed with\n\
+        [min mean max variance] of X Y Z and field F, and [mean variance] of\n\
+        the heading as circular statistic. example: -s 1,60\n\
+   -S   spectral analysis (requires -c/-p, not with -a) while the data output\n\
+        continues. Every 256 samples, prints the amplitude of the listed\n\
+        frequencies in Hz (sliding Goertzel, aliased into the sample rate),\n\
+        and per axis the RMS and strongest peaks of a Hann-windowed FFT.\n\
+        example: -S 50,60,100,120\n\
    -t   take a single measurement\n\
-   -o   output data to HTML table file (requires -t/-c), example: -o ./mmc3416.html\n\
+   -o   output data to a file (requires -t/-c/-p), repeat -o for several\n\
+        outputs. The type prefix selects the format, a file without prefix\n\
+        is a HTML table with the latest sample. File - writes to stdout,\n\
+        and replaces the default text output. An optional filter chain\n\
+        after '@' (see -f) is only used for this output, default: -f chain.\n\
+             csv:file  = CSV lines with header: ts,x,y,z,heading\n\
+             json:file = one JSON object per line\n\
+             text:file = text lines, same as the stdout output\n\
+        example: -o ./mmc3416.html -o csv:./day1.csv@cic:50\n\
    -h   display this message\n\
    -v   enable debug output\n\
+   -x   run a shell command for each event start and end (requires -e). The\n\
+        event details are in $MMC3416_EVENT, $MMC3416_TS, $MMC3416_DEV.\n\
+   -w   record raw samples to file (requires -c), CSV text or binary\n\
+        if the file name ends with .bin, example: -w ./day1.csv\n\
+   -W   flight recorder (requires -c): keep the last 'records' raw samples\n\
+        (default 30000, 10 min at 50 Hz) in a fixed size memory-mapped ring\n\
+        file, up to 1000000 records. It survives a crash of the program, a\n\
+        restart continues the ring with its own size, a different 'records'\n\
+        needs a new file. example: -W /var/tmp/mmc3416.ring:90000\n\
+   -X   extract a -W ring file to stdout in time order, as CSV recording\n\
+        for -p. Works while the recorder runs. example: -X ./mmc3416.ring\n\
 \n\
 \n\
 Usage examples:\n\
 ./getmmc3416 -b /dev/i2c-0 -i\n\
 ./getmmc3416 -t -v\n\
 ./getmmc3416 -c 1\n\
-./getmmc3416 -t -l 7.73 -o ./mmc3416.html\n\n";
+./getmmc3416 -c 3 -w ./day1.bin\n\
+./getmmc3416 -c 3 -W ./mmc3416.ring\n\
+./getmmc3416 -X ./mmc3416.ring > crash.csv\n\
+./getmmc3416 -c 3 -f med:5,cic:10\n\
+./getmmc3416 -c 2 -K ./cal.txt\n\
+./getmmc3416 -c 3 -k ./cal.txt -l 7.73\n\
+./getmmc3416 -c 3 -s 1,60\n\
+./getmmc3416 -c 0 -a 200\n\
+./getmmc3416 -c 3 -A > adev.txt\n\
+./getmmc3416 -c 3 -S 50,60,100,120 -s 1\n\
+./getmmc3416 -c 3 -o json:- -o ./mmc3416.html@avg:50\n\
+./getmmc3416 -c 3 -C ./mmc3416.conf & kill -HUP $!\n\
+./getmmc3416 -c 3 -e 5:50:2 -x 'logger door $MMC3416_EVENT'\n\
+./getmmc3416 -p ./day1.bin -p ./day2.bin -l 7.73\n\
+./getmmc3416 -t -l 7.73 -o ./mmc3416.html\n\
+./getmmc3416 -t -n 64 -N 0.1\n\
+./getmmc3416 -t -F 5\n\n";
    printf(usage);
 }
 
 /* ------------------------------------------------------------ *
  * parseargs() checks the commandline arguments with C getopt   *
  * -d = argflag 1     -i = argflag 2       -r = argflag 3       *
- * -t = argflag 4     -c = argflag 5       -o = outflag 1       *
+ * -t = argflag 4     -c = argflag 5       -p = argflag 7       *
+ * -X = argflag 8                                               *
  * ------------------------------------------------------------ */
 void parseargs(int argc, char* argv[]) {
    int arg;
@@ -87,8 +211,23 @@ void parseargs(int argc, char* argv[]) {
 
    if(argc == 1) { usage(); exit(-1); }
 
-   while ((arg = (int) getopt (argc, argv, "b:c:dil:m:rto:hv")) != -1) {
+   while ((arg = (int) getopt (argc, argv, "a:Ab:c:C:de:E:f:F:ij:k:K:l:m:n:N:rRs:S:tp:o:hvw:W:x:X:")) != -1) {
       switch (arg) {
+         // arg -a + adaptive frequency spec, type: string, example: 200:100:10
+         case 'a':
+            if(verbose == 1) printf("Debug: arg -a, value %s\n", optarg);
+            if(adapt_parse(optarg, &adapt) != 0) {
+               printf("Error: adaptive spec must be up[:down[:quiet]], down <= up.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -A runs the Allan deviation analysis
+         case 'A':
+            if(verbose == 1) printf("Debug: arg -A\n");
+            allan_init(&allan, ALLAN_MAXTAU);
+            break;
+
          // arg -b + I2C bus device name, type: string, example: "/dev/i2c-1"
          case 'b':
             if(verbose == 1) printf("Debug: arg -b, value %s\n", optarg);
@@ -114,18 +253,95 @@ void parseargs(int argc, char* argv[]) {
             }
             break;
 
+         // arg -C + config file name, type: string, requires -c
+         // read at the start, and again on SIGHUP. example: ./mmc3416.conf
+         case 'C':
+            if(verbose == 1) printf("Debug: arg -C, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(conffile)) {
+               printf("Error: config file argument to long.\n");
+               exit(-1);
+            }
+            strncpy(conffile, optarg, sizeof(conffile));
+            break;
+
          // arg -d dumps the complete register map data
          case 'd':
             if(verbose == 1) printf("Debug: arg -d\n");
             argflag = 1;
             break;
 
+         // arg -e + event detector spec, type: string, example: 5:50:2
+         case 'e':
+            if(verbose == 1) printf("Debug: arg -e, value %s\n", optarg);
+            if(event_parse(optarg, &event) != 0) {
+               printf("Error: event spec must be k:h[:hold], with h > 0.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -E + event FIFO path, type: string
+         case 'E':
+            if(verbose == 1) printf("Debug: arg -E, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(event.fifo)) {
+               printf("Error: event FIFO argument to long.\n");
+               exit(-1);
+            }
+            strncpy(event.fifo, optarg, sizeof(event.fifo));
+            break;
+
+         // arg -f + filter chain spec, type: string, example: med:5,iir:0.2
+         case 'f':
+            if(verbose == 1) printf("Debug: arg -f, value %s\n", optarg);
+            if(strlen(optarg) >= sizeof(filterspec)) {
+               printf("Error: filter argument to long.\n");
+               exit(-1);
+            }
+            if(filter_parse(optarg, &outfilter) != 0) exit(-1);
+            strcpy(filterspec, optarg);
+            break;
+
+         // arg -F freshness window in seconds for shared -t results
+         case 'F':
+            if(verbose == 1) printf("Debug: arg -F, value %s\n", optarg);
+            cacheage = atof(optarg);
+            if(cacheage <= 0) {
+               printf("Error: result freshness window must be > 0 seconds.\n");
+               exit(-1);
+            }
+            break;
+
          // arg -i prints sensor information
          case 'i':
             if(verbose == 1) printf("Debug: arg -i\n");
             argflag = 2;
             break;
 
+         // arg -j sets the number of parallel replay workers, type: int
+         case 'j':
+            if(verbose == 1) printf("Debug: arg -j, value %s\n", optarg);
+            playjobs = atoi(optarg);
+            if(playjobs < 1) {
+               printf("Error: replay worker count must be 1 or more.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -k + calibration file to apply, type: string
+         case 'k':
+            if(verbose == 1) printf("Debug: arg -k, value %s\n", optarg);
+            if(calib_load(optarg, &cal) != 0) exit(-1);
+            break;
+
+         // arg -K + calibration file to create, type: string
+         case 'K':
+            if(verbose == 1) printf("Debug: arg -K, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(calfile)) {
+               printf("Error: calibration file argument to long.\n");
+               exit(-1);
+            }
+            strncpy(calfile, optarg, sizeof(calfile));
+            break;
+
          // arg -l sets local declination value, type: float example: 7.37
          case 'l':
             if(verbose == 1) printf("Debug: arg -l\n");
@@ -140,15 +356,70 @@ void parseargs(int argc, char* argv[]) {
          // arg -m sets output resolution mode, type: string values 12/14/16/16h
          case 'm':
             if(verbose == 1) printf("Debug: arg -m, value %s\n", optarg);
-            if (strlen(optarg) >= sizeof(outres_set)) {
-               printf("Error: output resolution mode argument to long.\n");
+            outres_set = outres_parse(optarg);
+            if(outres_set < 0) {
+               printf("Error: output resolution mode arg must be 12, 14, 16 or 16h.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -n burst count for -t, type: int 2..BURST_MAX, example: 64
+         case 'n':
+            if(verbose == 1) printf("Debug: arg -n, value %s\n", optarg);
+            burst.count = atoi(optarg);
+            if(burst.count < 2 || burst.count > BURST_MAX) {
+               printf("Error: burst count must be between 2..%d.\n", BURST_MAX);
+               exit(-1);
+            }
+            break;
+
+         // arg -N burst noise target in mGauss, type: float, requires -n
+         case 'N':
+            if(verbose == 1) printf("Debug: arg -N, value %s\n", optarg);
+            burst.target = atof(optarg);
+            if(burst.target <= 0) {
+               printf("Error: burst noise target must be > 0 mGauss.\n");
                exit(-1);
             }
-            if(optarg[0] != '1') {
-               printf("Error: output resolution mode arg should start with '1'.\n");
+            break;
+
+         // arg -p + recording file name, type: string, repeatable
+         case 'p':
+            if(verbose == 1) printf("Debug: arg -p, value %s\n", optarg);
+            argflag = 7;
+            if(playcount >= MAXREPLAY) {
+               printf("Error: too many replay files, max is %d.\n", MAXREPLAY);
                exit(-1);
             }
-            strncpy(outres_set, optarg, sizeof(outres_set));
+            playfile[playcount++] = optarg;
+            break;
+
+         // arg -R replays at the recorded pace
+         case 'R':
+            if(verbose == 1) printf("Debug: arg -R\n");
+            playpace = 1;
+            break;
+
+         // arg -s + rollup window length list, type: string, example: 1,60
+         case 's': {
+            if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
+            char *p = optarg, *end;
+            while(*p != '\0') {
+               long len = strtol(p, &end, 10);
+               if(end == p || len < 1 || len > 86400 || rollcount == MAXROLLUP) {
+                  printf("Error: rollup windows must be 1..86400 seconds, max %d.\n", MAXROLLUP);
+                  exit(-1);
+               }
+               rollup_init(&rollup[rollcount++], (int) len);
+               p = (*end == ',') ? end + 1 : end;
+            }
+            break;
+         }
+
+         // arg -S + spectral analysis frequency list, type: string, example: 50,60
+         case 'S':
+            if(verbose == 1) printf("Debug: arg -S, value %s\n", optarg);
+            if(spec_parse(optarg, &spec) != 0) exit(-1);
             break;
 
          // arg -r
@@ -164,16 +435,18 @@ void parseargs(int argc, char* argv[]) {
             argflag = 4;
             break;
 
-         // arg -o + dst HTML file, type: string, requires -t
-         // writes the sensor output to file. example: /tmp/sensor.htm
+         // arg -o + output sink, type: string, repeatable, requires -t/-c/-p
+         // [csv:|json:|text:]file[@filter], a plain file is a HTML table.
+         // example: -o /tmp/sensor.htm -o csv:/tmp/day1.csv@cic:50
          case 'o':
-            outflag = 1;
             if(verbose == 1) printf("Debug: arg -o, value %s\n", optarg);
-            if (strlen(optarg) >= sizeof(htmfile)) {
-               printf("Error: html file argument to long.\n");
+            if(sinkcount == MAXSINK) {
+               printf("Error: too many outputs, max %d.\n", MAXSINK);
                exit(-1);
             }
-            strncpy(htmfile, optarg, sizeof(htmfile));
+            if(sink_parse(optarg, &sink[sinkcount]) != 0) exit(-1);
+            if(strcmp(sink[sinkcount].path, "-") == 0) sinkstdout = 1;
+            sinkcount++;
             break;
 
          // arg -h usage, type: flag, optional
@@ -185,6 +458,63 @@ void parseargs(int argc, char* argv[]) {
          case 'v':
             verbose = 1; break;
 
+         // arg -x + event command, type: string
+         case 'x':
+            if(verbose == 1) printf("Debug: arg -x, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(event.cmd)) {
+               printf("Error: event command argument to long.\n");
+               exit(-1);
+            }
+            strncpy(event.cmd, optarg, sizeof(event.cmd));
+            break;
+
+         // arg -w + raw sample record file, type: string, requires -c
+         case 'w':
+            if(verbose == 1) printf("Debug: arg -w, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(recfile)) {
+               printf("Error: record file argument to long.\n");
+               exit(-1);
+            }
+            strncpy(recfile, optarg, sizeof(recfile));
+            break;
+
+         // arg -W + ring file with optional :records, requires -c
+         case 'W': {
+            if(verbose == 1) printf("Debug: arg -W, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(ringfile)) {
+               printf("Error: ring file argument to long.\n");
+               exit(-1);
+            }
+            strncpy(ringfile, optarg, sizeof(ringfile));
+            char *num = strrchr(ringfile, ':');
+            if(num != NULL) {
+               char *end;
+               *num++ = '\0';
+               long n = strtol(num, &end, 10);
+               if(end == num || *end != '\0' || n < 2 || n > RING_MAXSLOTS) {
+                  printf("Error: ring records must be 2..%d.\n", RING_MAXSLOTS);
+                  exit(-1);
+               }
+               ringslots = (uint32_t) n;
+            }
+            if(ringfile[0] == '\0') {
+               printf("Error: -W needs a ring file name.\n");
+               exit(-1);
+            }
+            break;
+         }
+
+         // arg -X + ring file to extract, type: string
+         case 'X':
+            if(verbose == 1) printf("Debug: arg -X, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(ringfile)) {
+               printf("Error: ring file argument to long.\n");
+               exit(-1);
+            }
+            strncpy(ringfile, optarg, sizeof(ringfile));
+            argflag = 8;
+            break;
+
          case '?':
             if(isprint (optopt))
                printf ("Error: Unknown option `-%c'.\n", optopt);
@@ -201,6 +531,327 @@ void parseargs(int argc, char* argv[]) {
    }
 }
 
+/* ------------------------------------------------------------ *
+ * stop_handler() ends the continuous read or replay loop after *
+ * the current sample, so that all outputs are closed cleanly.  *
+ * ------------------------------------------------------------ */
+void stop_handler(int sig) {
+   stopflag = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * hup_handler() requests a config reload before the next read  *
+ * ------------------------------------------------------------ */
+void hup_handler(int sig) {
+   reloadflag = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * print_rollup() prints one closed rollup window (Example):    *
+ * 1634960400 Rollup=60s Count=3000 X=[min mean max var] ...    *
+ * ------------------------------------------------------------ */
+void print_rollup(struct mmc3416rollup *r) {
+   static const char axisname[4] = { 'X', 'Y', 'Z', 'F' };
+   double cvar;
+
+   printf("%lld Rollup=%ds Count=%ld", (long long) r->start, r->len, r->count);
+   for(int a=0; a<4; a++) {
+      printf(" %c=[%.2f %.2f %.2f %.3f]", axisname[a], r->axis[a].min,
+             r->axis[a].mean, r->axis[a].max, rollup_variance(r, a));
+   }
+   double deg = rollup_heading(r, &cvar);
+   printf(" Heading=[%3.1f %.4f]\n", deg, cvar);
+}
+
+/* ------------------------------------------------------------ *
+ * flush_rollups() prints the last, incomplete rollup windows   *
+ * ------------------------------------------------------------ */
+void flush_rollups() {
+   struct mmc3416rollup done;
+   for(int i=0; i<rollcount; i++) {
+      if(rollup_flush(&rollup[i], &done) == 1) print_rollup(&done);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * open_sinks() opens all -o outputs. Parallel replay workers   *
+ * add the recording name, so each file gets its own outputs.   *
+ * ------------------------------------------------------------ */
+int open_sinks(char *suffix) {
+   for(int i=0; i<sinkcount; i++) {
+      if(sink_open(&sink[i], suffix) != 0) return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * close_sinks() writes out the buffered lines and closes them  *
+ * ------------------------------------------------------------ */
+void close_sinks() {
+   for(int i=0; i<sinkcount; i++) sink_close(&sink[i]);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_deffilter() gives outputs without an '@' filter a copy  *
+ * of the -f filter chain.                                      *
+ * ------------------------------------------------------------ */
+void sink_deffilter(struct mmc3416sink *k) {
+   if(strchr(k->spec, '@') == NULL) k->filter = outfilter;
+}
+
+/* ------------------------------------------------------------ *
+ * config_outputs() swaps in the output list of the config.     *
+ * Outputs with the same spec are kept with their open file,    *
+ * buffer and filter state, outputs with the same type and path *
+ * keep the file and get the new filter. New outputs are opened *
+ * first, if one fails, the running outputs stay as they are.   *
+ * A file that a closing output still holds is opened after it  *
+ * is closed, so it is not truncated under the old output.      *
+ * ------------------------------------------------------------ */
+int config_outputs(struct mmc3416conf *cf) {
+   static struct mmc3416sink newsink[MAXSINK];
+   int keep[MAXSINK] = {0};   // old sink index + 1 per new sink
+   int used[MAXSINK] = {0};   // 1 = old sink is kept
+   int late[MAXSINK] = {0};   // 1 = open after the old sinks closed
+   int res = 0, n = 0;
+
+   /* pass 0 matches the spec, pass 1 the type and path */
+   for(int pass=0; pass<2; pass++) {
+      for(int j=0; j<cf->nsink; j++) {
+         for(int i=0; i<sinkcount && keep[j] == 0; i++) {
+            if(used[i] == 1) continue;
+            if(pass == 0 ? strcmp(sink[i].spec, cf->sink[j].spec) == 0
+                         : (sink[i].type == cf->sink[j].type
+                            && strcmp(sink[i].path, cf->sink[j].path) == 0)) {
+               used[i] = 1;
+               keep[j] = i + 1;
+            }
+         }
+      }
+   }
+   for(int j=0; j<cf->nsink; j++) {
+      if(keep[j] > 0) continue;
+      newsink[j] = cf->sink[j];
+      sink_deffilter(&newsink[j]);
+      for(int i=0; i<sinkcount; i++) {
+         if(used[i] == 0 && strcmp(sink[i].path, newsink[j].path) == 0
+            && strcmp(newsink[j].path, "-") != 0) late[j] = 1;
+      }
+      if(late[j] == 1) continue;
+      if(sink_open(&newsink[j], NULL) != 0) {
+         for(int k=0; k<j; k++) if(keep[k] == 0 && late[k] == 0) sink_close(&newsink[k]);
+         return(-1);
+      }
+   }
+   for(int i=0; i<sinkcount; i++) if(used[i] == 0) sink_close(&sink[i]);
+   for(int j=0; j<cf->nsink; j++) {
+      if(keep[j] > 0) {
+         newsink[j] = sink[keep[j] - 1];
+         if(strcmp(newsink[j].spec, cf->sink[j].spec) != 0) {
+            strcpy(newsink[j].spec, cf->sink[j].spec);
+            newsink[j].filter = cf->sink[j].filter;
+            sink_deffilter(&newsink[j]);
+         }
+      }
+      else if(late[j] == 1 && sink_open(&newsink[j], NULL) != 0) {
+         late[j] = -1;                          // dropped
+         res = -1;
+      }
+   }
+   sinkstdout = 0;
+   for(int j=0; j<cf->nsink; j++) {
+      if(late[j] == -1) continue;
+      sink[n] = newsink[j];
+      if(strcmp(sink[n].path, "-") == 0) sinkstdout = 1;
+      n++;
+   }
+   sinkcount = n;
+   return(res);
+}
+
+/* ------------------------------------------------------------ *
+ * config_apply() applies the changes of the config between two *
+ * samples. Sensor registers are only written for a new rate or *
+ * resolution, filter and outputs only swapped if their spec    *
+ * changed. mode is the current read mode of the running loop.  *
+ * Returns -1 if the sensor could not be set, so that the loop  *
+ * sets it again before the next sample.                        *
+ * ------------------------------------------------------------ */
+int config_apply(struct mmc3416conf *cf, int *mode) {
+   int res = 0;
+
+   if(cf->cmfreq >= 0 && cf->cmfreq != cmfreq_mode) {
+      int newmode = cf->cmfreq;
+      cmfreq_mode = cf->cmfreq;
+      if(adapt.enabled == 1) newmode = adapt_setmin(&adapt, cmfreq_mode, get_time());
+      if(newmode >= 0 && newmode != *mode) {
+         *mode = newmode;
+         if(set_cmfreq(newmode) != 0) res = -1;
+         /* rate dependent analysis restarts, Allan prints the old rate */
+         if(spec.enabled == 1) spec_reset(&spec);
+         if(allan.enabled == 1) {
+            allan_print(&allan);
+            allan_init(&allan, allan.ntau);
+         }
+      }
+   }
+   if(cf->outres >= 0 && cf->outres != outres_set) {
+      outres_set = cf->outres;
+      if(set_outres(outres_set) != 0) res = -1;
+   }
+   if(cf->havedecl == 1) declination = cf->declination;
+   if(cf->havefilter == 1 && strcmp(cf->filterspec, filterspec) != 0) {
+      outfilter = cf->filter;
+      strcpy(filterspec, cf->filterspec);
+      for(int i=0; i<sinkcount; i++) sink_deffilter(&sink[i]);
+   }
+   if(cf->haveoutput == 1 && config_outputs(cf) != 0) {
+      printf("Error: could not open the config outputs, keeping the old ones.\n");
+   }
+   if(verbose == 1) printf("Debug: Config applied, mode %d, %d outputs\n", *mode, sinkcount);
+   return(res);
+}
+
+/* ------------------------------------------------------------ *
+ * process_sample() runs one live or replayed sample through    *
+ * the processing pipeline: conversion, filter, heading and     *
+ * output. Decimating filters only pass every Nth sample on,   *
+ * samples flagged SAMPLE_INVALID are skipped.                  *
+ * ------------------------------------------------------------ */
+void process_sample(struct mmc3416sample *s) {
+   if(s->status & SAMPLE_INVALID) return;
+   mmc3416_convert(s);
+   if(calfile[0] != '\0') calib_add(&calfit, &s->data);
+   if(cal.valid == 1) calib_apply(&cal, &s->data);
+
+   /* ----------------------------------------------------------- *
+    * events, Allan deviation and rollups see the data after the  *
+    * calibration, but before the output filter chain. Allan and  *
+    * rollups replace the sample output.                          *
+    * ----------------------------------------------------------- */
+   if(event.enabled == 1) event_update(&event, s);
+   if(spec.enabled == 1) spec_add(&spec, s);
+
+   /* ----------------------------------------------------------- *
+    * the output sinks get every sample through their own filter  *
+    * ----------------------------------------------------------- */
+   for(int i=0; i<sinkcount; i++) {
+      struct mmc3416sample out = *s;
+      if(filter_run(&sink[i].filter, &out.data) == 0) continue;
+      out.heading = get_heading(&out.data);
+      sink_write(&sink[i], &out);
+   }
+   if(allan.enabled == 1) {
+      allan_add(&allan, s);
+      if(rollcount == 0) return;
+   }
+   if(rollcount > 0) {
+      struct mmc3416rollup done;
+      s->heading = get_heading(&s->data);
+      for(int i=0; i<rollcount; i++) {
+         if(rollup_add(&rollup[i], s, &done) == 1) print_rollup(&done);
+      }
+      return;
+   }
+   if(sinkstdout == 1) return;
+   if(filter_run(&outfilter, &s->data) == 0) return;
+   s->heading = get_heading(&s->data);
+   /* ----------------------------------------------------------- *
+    * print the formatted output string to stdout (Example below) *
+    * 1634960403.120 X=-81.05 Y=52.73 Z=-399.41 Heading=326.0 deg *
+    * ----------------------------------------------------------- */
+   printf("%.3f X=%.2f Y=%.2f Z=%.2f Heading=%3.1f degrees\n",
+          s->ts, s->data.X, s->data.Y, s->data.Z, s->heading);
+}
+
+/* ------------------------------------------------------------ *
+ * calib_finish() solves the calibration data collected with -K *
+ * and writes it to the calibration file.                       *
+ * ------------------------------------------------------------ */
+int calib_finish() {
+   struct mmc3416cal newcal = {0};
+
+   if(calib_solve(&calfit, &newcal) != 0) return(-1);
+   if(calib_save(calfile, &newcal) != 0) return(-1);
+   printf("Calibration: %ld samples, field %3.1f mGauss, residual %.4f\n",
+          calfit.count, newcal.radius, newcal.residual);
+   printf("Calibration: bias X=%.2f Y=%.2f Z=%.2f written to %s\n",
+          newcal.bias[0], newcal.bias[1], newcal.bias[2], calfile);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * replay_file() runs a single recording through the pipeline.  *
+ * ------------------------------------------------------------ */
+int replay_file(char *file) {
+   struct mmc3416replay rp;
+   struct mmc3416sample s;
+   int res;
+
+   if(replay_open(file, playpace, &rp) != 0) return(-1);
+   char *name = strrchr(file, '/');
+   if(open_sinks(playcount > 1 ? (name ? name + 1 : file) : NULL) != 0) {
+      replay_close(&rp);
+      return(-1);
+   }
+   while(stopflag == 0 && (res = replay_next(&rp, &s)) == 1) {
+      process_sample(&s);
+   }
+   close_sinks();
+   flush_rollups();
+   if(event.enabled == 1) event_report(&event);
+   if(allan.enabled == 1) allan_print(&allan);
+   if(verbose == 1) printf("Debug: Replay [%s] done, %ld lines\n", file, rp.line);
+   replay_close(&rp);
+   return(res < 0 ? -1 : 0);
+}
+
+/* ------------------------------------------------------------ *
+ * replay_parallel() forks one worker per recording, with up to *
+ * playjobs workers running at the same time. Each worker gets  *
+ * its own pipeline state, and writes its output to <file>.out. *
+ * ------------------------------------------------------------ */
+int replay_parallel() {
+   int running = 0, failed = 0, status;
+   char outfile[512];
+
+   if(playjobs == 0) playjobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+   if(playjobs < 1) playjobs = 1;
+
+   for(int i=0; i<playcount; i++) {
+      if(running == playjobs) {
+         if(wait(&status) > 0) {
+            running--;
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+         }
+         else running = 0;                      // no workers left to wait for
+      }
+      fflush(stdout);
+      pid_t pid = fork();
+      if(pid < 0) {
+         printf("Error: could not start replay worker for [%s].\n", playfile[i]);
+         failed++;
+         continue;
+      }
+      if(pid == 0) {
+         snprintf(outfile, sizeof(outfile), "%s.out", playfile[i]);
+         if(freopen(outfile, "w", stdout) == NULL) exit(-1);
+         int res = replay_file(playfile[i]);
+         fclose(stdout);
+         exit(res == 0 ? 0 : -1);
+      }
+      if(verbose == 1) printf("Debug: Replay worker %d for [%s]\n", (int) pid, playfile[i]);
+      running++;
+   }
+   while(running > 0) {
+      if(wait(&status) <= 0) break;
+      running--;
+      if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+   }
+   if(failed > 0) printf("Error: %d of %d replay files failed.\n", failed, playcount);
+   return(failed > 0 ? -1 : 0);
+}
+
 int main(int argc, char *argv[]) {
    int res = -1;       // res = function retcode: 0=OK, -1 = Error
    declination = 0;    // local declination value
@@ -216,10 +867,85 @@ int main(int argc, char *argv[]) {
    time_t tsnow = time(NULL);
    if(verbose == 1) printf("Debug: ts=[%lld] date=%s", (long long) tsnow, ctime(&tsnow));
 
+   if(cacheage > 0 && argflag != 4) {
+      printf("Error: -F shared results require a single measurement -t.\n");
+      exit(-1);
+   }
+   if(burst.count > 0 && argflag != 4) {
+      printf("Error: -n burst requires a single measurement -t.\n");
+      exit(-1);
+   }
+   if(burst.target > 0 && burst.count == 0) {
+      printf("Error: -N noise target requires a burst count -n.\n");
+      exit(-1);
+   }
+   if(ringfile[0] != '\0' && argflag != 5 && argflag != 8) {
+      printf("Error: -W flight recorder requires continuous read -c.\n");
+      exit(-1);
+   }
+   if(calfile[0] != '\0' && argflag != 5 && argflag != 7) {
+      printf("Error: -K calibration requires continuous read -c or replay -p.\n");
+      exit(-1);
+   }
+   if(conffile[0] != '\0' && argflag != 5) {
+      printf("Error: -C config file requires continuous read -c.\n");
+      exit(-1);
+   }
+   if(adapt.enabled == 1 && argflag != 5) {
+      printf("Error: -a adaptive read frequency requires continuous read -c.\n");
+      exit(-1);
+   }
+   if((allan.enabled == 1 || spec.enabled == 1 || event.enabled == 1 || rollcount > 0
+       || filterspec[0] != '\0') && argflag != 5 && argflag != 7) {
+      printf("Error: -A, -S, -e, -s and -f require continuous read -c or replay -p.\n");
+      exit(-1);
+   }
+   if((event.fifo[0] != '\0' || event.cmd[0] != '\0') && event.enabled == 0) {
+      printf("Error: -E and -x require event detection -e.\n");
+      exit(-1);
+   }
+   if((playpace == 1 || playjobs > 0) && argflag != 7) {
+      printf("Error: -R and -j require replay -p.\n");
+      exit(-1);
+   }
+   if(spec.enabled == 1 && adapt.enabled == 1) {
+      printf("Error: -S spectral analysis needs a fixed rate, not -a.\n");
+      exit(-1);
+   }
+
+   /* ----------------------------------------------------------- *
+    * sinks without their own filter chain use the -f filter      *
+    * ----------------------------------------------------------- */
+   for(int i=0; i<sinkcount; i++) sink_deffilter(&sink[i]);
+
+   signal(SIGINT, stop_handler);
+   signal(SIGTERM, stop_handler);
+   signal(SIGPIPE, SIG_IGN);
+
+   /* ----------------------------------------------------------- *
+    *  "-p" replay recordings through the pipeline, no sensor I/O *
+    * ----------------------------------------------------------- */
+   if(argflag == 7) {
+      if(calfile[0] != '\0' && playcount > 1) {
+         printf("Error: -K calibration works on a single replay file.\n");
+         exit(-1);
+      }
+      if(playcount == 1) res = replay_file(playfile[0]);
+      else res = replay_parallel();
+      if(res == 0 && calfile[0] != '\0') res = calib_finish();
+      exit(res == 0 ? 0 : -1);
+   }
+
+   /* ----------------------------------------------------------- *
+    *  "-X" extract the flight recorder ring, no sensor I/O        *
+    * ----------------------------------------------------------- */
+   if(argflag == 8) exit(ring_dump(ringfile) == 0 ? 0 : -1);
+
    /* ----------------------------------------------------------- *
     * Open the I2C bus and connect to the sensor i2c address 0x30 *
+    * -t opens it later, after it holds the bus lock.             *
     * ----------------------------------------------------------- */
-   get_i2cbus(i2c_bus, I2C_ADDR);
+   if(argflag != 4) get_i2cbus(i2c_bus, I2C_ADDR);
 
    /* ----------------------------------------------------------- *
     *  "-d" dump the register map content and exit the program    *
@@ -238,7 +964,10 @@ int main(int argc, char *argv[]) {
     * ----------------------------------------------------------- */
     if(argflag == 2) {
       struct mmc3416inf mmc3416i = {0};
-      mmc3416_info(&mmc3416i);
+      if(mmc3416_info(&mmc3416i) != 0) {
+         printf("Error: could not read the sensor information.\n");
+         exit(-1);
+      }
 
       /* ----------------------------------------------------------- *
        * print the formatted output strings to stdout                *
@@ -298,21 +1027,72 @@ int main(int argc, char *argv[]) {
     * ----------------------------------------------------------- */
    if(argflag == 4) {
       struct mmc3416data mmc3416d;
+      struct mmc3416sample s;
+
+      /* ----------------------------------------------------------- *
+       * a burst without -m runs at the fastest resolution that      *
+       * meets the noise target                                      *
+       * ----------------------------------------------------------- */
+      if(burst.count > 0 && outres_set < 0) outres_set = burst_outres(&burst);
+      burst.outres = outres_set;
 
-      mmc3416_init(&mmc3416d);
-      res = mmc3416_read(&mmc3416d);
+      /* ----------------------------------------------------------- *
+       * concurrent -t calls queue on the bus lock, so only one      *
+       * touches the bus. A fresh result with the same settings is   *
+       * shared, without opening the bus at all (-F). Without the    *
+       * lock there is no measurement, without the result file no    *
+       * sharing.                                                    *
+       * ----------------------------------------------------------- */
+      int busfd = bus_lock(i2c_bus);
+      if(busfd < 0) exit(-1);
+      int cachefd = cache_open(i2c_bus);
+      if(cache_get(cachefd, cacheage, &burst, &s) == 1) res = 0;
+      else {
+         get_i2cbus(i2c_bus, I2C_ADDR);
+         if(outres_set >= 0 && set_outres(outres_set) != 0) exit(-1);
+         if(mmc3416_init(&mmc3416d) != 0) {
+            printf("Error: could not initialize the sensor.\n");
+            exit(-1);
+         }
+         /* one more try after the bus recovery, with the resolution */
+         /* set again, as the sensor may have been reset            */
+         if(burst.count > 0) {
+            res = mmc3416_burst(&burst, &s);
+            if(res != 0 && (outres_set < 0 || set_outres(outres_set) == 0))
+               res = mmc3416_burst(&burst, &s);
+         }
+         else {
+            res = mmc3416_getsample(&s, 1);
+            if(res != 0 && (outres_set < 0 || set_outres(outres_set) == 0))
+               res = mmc3416_getsample(&s, 1);
+            if(res == 0) mmc3416_convert(&s);
+         }
+         if(res == 0) cache_put(cachefd, &burst, &s);
+      }
+      cache_close(cachefd);
+      bus_unlock(busfd);
       if(res != 0) {
          printf("Error: could not read data from the sensor.\n");
          exit(-1);
       }
-      float angle = get_heading(&mmc3416d);
+      /* the shared result is uncorrected, each caller applies -k */
+      if(cal.valid == 1) calib_apply(&cal, &s.data);
+      float angle = get_heading(&s.data);
+      if(sinkcount > 0) {
+         s.heading = angle;
+         if(open_sinks(NULL) != 0) exit(-1);
+         for(int i=0; i<sinkcount; i++) sink_write(&sink[i], &s);
+         close_sinks();
+         if(sinkstdout == 1) exit(0);
+      }
       /* ----------------------------------------------------------- *
        * print the formatted output string to stdout (Example below) *
        * 1584280335 Heading=337.2 degrees                            *
        * Note the sensor has a accuracy of +/-1 degree, fractions    *
        * don't make much sense. Consider taking them off...          *
        * ----------------------------------------------------------- */
-         printf("%lld Heading=%3.1f degrees\n", (long long) tsnow, angle);
+         printf("%lld Heading=%3.1f degrees\n", (long long) s.ts, angle);
+      if(burst.count > 0) burst_report(&burst);
       exit(0);
    }
 
@@ -321,11 +1101,120 @@ int main(int argc, char *argv[]) {
     * ctl-c is received.                                          *
     * ----------------------------------------------------------- */
    if(argflag == 5) {
+      struct mmc3416data mmc3416d;
+      struct mmc3416sample s;
+      FILE *recfp = NULL;
+      int recbin = 0;
+
+      /* ----------------------------------------------------------- *
+       * the config file overrides the command line rate/resolution  *
+       * ----------------------------------------------------------- */
+      if(conffile[0] != '\0') {
+         if(config_load(conffile, &conf) != 0) exit(-1);
+         if(conf.cmfreq >= 0) cmfreq_mode = conf.cmfreq;
+         if(conf.outres >= 0) outres_set = conf.outres;
+         signal(SIGHUP, hup_handler);
+      }
+      if(outres_set >= 0 && set_outres(outres_set) != 0) exit(-1);
+      if(mmc3416_init(&mmc3416d) != 0) {
+         printf("Error: could not initialize the sensor.\n");
+         exit(-1);
+      }
       res = set_cmfreq(cmfreq_mode);
       if(res != 0) {
          printf("Error: could not set continuous mode %d.\n", cmfreq_mode);
          exit(-1);
       }
-      exit(0);
+
+      if(recfile[0] != '\0') {
+         size_t len = strlen(recfile);
+         if(len > 4 && strcmp(recfile + len - 4, ".bin") == 0) recbin = 1;
+         recfp = record_open(recfile, recbin);
+         if(recfp == NULL) exit(-1);
+      }
+      if(ringfile[0] != '\0' && ring_open(ringfile, ringslots, &ring) != 0) exit(-1);
+      if(open_sinks(NULL) != 0) exit(-1);
+
+      /* ----------------------------------------------------------- *
+       * Sleep most of the sample period, then poll the status reg.  *
+       * ----------------------------------------------------------- */
+      static const long cm_period[4] = { 667, 77, 40, 20 };
+      int curmode = cmfreq_mode;
+      int rearm = 0;      // 1 = continuous mode needs to be set again
+      long sleep_ms = cm_period[curmode] - 3;
+      if(adapt.enabled == 1) adapt_start(&adapt, curmode, get_time());
+      if(conffile[0] != '\0' && config_apply(&conf, &curmode) != 0) exit(-1);
+
+      while(stopflag == 0) {
+         /* -------------------------------------------------------- *
+          * SIGHUP: reload the config between two samples, the      *
+          * running config stays if the file has errors             *
+          * -------------------------------------------------------- */
+         if(reloadflag == 1) {
+            reloadflag = 0;
+            if(config_load(conffile, &conf) == 0 && config_apply(&conf, &curmode) != 0) rearm = 1;
+            sleep_ms = cm_period[curmode] - 3;
+         }
+
+         /* -------------------------------------------------------- *
+          * after a bus recovery the sensor may have lost its mode   *
+          * -------------------------------------------------------- */
+         if(rearm == 1 && set_cmfreq(curmode) == 0
+            && (outres_set < 0 || set_outres(outres_set) == 0)) rearm = 0;
+
+         /* -------------------------------------------------------- *
+          * failed reads return an invalid sample, which is recorded *
+          * to mark the gap, but skipped by the processing pipeline  *
+          * -------------------------------------------------------- */
+         if(mmc3416_getsample(&s, 0) != 0) {
+            if(i2cstat.consecutive >= I2C_MAXFAIL) {
+               printf("Error: could not read data from the sensor.\n");
+               res = -1;
+               break;
+            }
+            rearm = 1;
+         }
+         if(recfp != NULL && record_write(recfp, recbin, &s) != 0) {
+            printf("Error: could not write record file [%s]: %s, recording stopped.\n",
+                   recfile, strerror(errno));
+            fclose(recfp);
+            recfp = NULL;
+            res = -1;
+         }
+         if(ring.hdr != NULL) ring_write(&ring, &s);
+         process_sample(&s);
+         fflush(stdout);
+         if(rearm == 1) continue;
+
+         /* -------------------------------------------------------- *
+          * adaptive mode: switch the rate before the next sample    *
+          * -------------------------------------------------------- */
+         if(adapt.enabled == 1) {
+            int newmode = adapt_update(&adapt, &s);
+            if(newmode >= 0) {
+               curmode = newmode;
+               sleep_ms = cm_period[curmode] - 3;
+               if(set_cmfreq(curmode) != 0) {
+                  printf("Error: could not set continuous mode %d.\n", curmode);
+                  rearm = 1;
+               }
+               continue;
+            }
+         }
+         delay(sleep_ms);
+      }
+      close_sinks();
+      flush_rollups();
+      if(adapt.enabled == 1) adapt_report(&adapt, get_time());
+      if(verbose == 1 || i2cstat.retries > 0 || i2cstat.recoveries > 0) i2c_report();
+      if(event.enabled == 1) event_report(&event);
+      if(allan.enabled == 1) allan_print(&allan);
+      if(recfp != NULL && fclose(recfp) != 0) {
+         printf("Error: could not write record file [%s]: %s\n", recfile, strerror(errno));
+         res = -1;
+      }
+      ring_close(&ring);
+      if(calfile[0] != '\0' && calib_finish() != 0) exit(-1);
+      exit(res == 0 ? 0 : -1);
    }
 }
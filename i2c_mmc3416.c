@@ -24,35 +24,136 @@
 #include <math.h>
 #include "mmc3416.h"
 
+/* ------------------------------------------------------------ *
+ * Global variables shared through mmc3416.h                    *
+ * ------------------------------------------------------------ */
+int i2cfd = -1;        // I2C file descriptor
+float offset[3];       // sensor axis offset values
+float declination;     // local declination value
+long i2c_xfers;        // I2C read/write transfers, including retries
+struct mmc3416i2cstat i2cstat; // I2C retry and recovery counters
+
+static char busname[256];  // I2C bus device, kept for i2c_recover()
+static int busaddr;        // sensor I2C address, kept for i2c_recover()
+
+/* ------------------------------------------------------------ *
+ * i2c_open() opens the I2C bus and selects the sensor address. *
+ * ------------------------------------------------------------ */
+static int i2c_open() {
+   if(i2cfd >= 0) close(i2cfd);
+   if((i2cfd = open(busname, O_RDWR)) < 0) return(-I2C_ERR_BUS);
+   if(ioctl(i2cfd, I2C_SLAVE, busaddr) != 0) return(-I2C_ERR_BUS);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * i2c_stall() books the time lost in retries and recoveries.   *
+ * ------------------------------------------------------------ */
+static void i2c_stall(double t0) {
+   double t = get_monotime() - t0;
+   i2cstat.stall += t;
+   if(t > i2cstat.maxstall) i2cstat.maxstall = t;
+}
+
+/* ------------------------------------------------------------ *
+ * i2c_xfer() writes wlen bytes (register address and data),    *
+ * then reads rlen bytes if rlen > 0. A failed transfer is      *
+ * repeated up to I2C_MAXRETRY times with a doubling backoff.   *
+ * Returns 0, or -I2C_ERR_WRITE / -I2C_ERR_READ.                *
+ * ------------------------------------------------------------ */
+static int i2c_xfer(char *wbuf, int wlen, void *rbuf, int rlen) {
+   double t0 = 0;
+   int err = 0;
+
+   for(int try=0; try<=I2C_MAXRETRY; try++) {
+      if(try > 0) {
+         if(t0 == 0) t0 = get_monotime();
+         i2cstat.retries++;
+         delay(I2C_BACKOFF_MS << (try - 1));
+      }
+      i2c_xfers++;
+      if(write(i2cfd, wbuf, wlen) != wlen) { err = I2C_ERR_WRITE; continue; }
+      if(rlen > 0) {
+         i2c_xfers++;
+         if(read(i2cfd, rbuf, rlen) != rlen) { err = I2C_ERR_READ; continue; }
+      }
+      err = 0;
+      break;
+   }
+   if(t0 > 0) i2c_stall(t0);
+   if(err == 0) return(0);
+
+   i2cstat.failures++;
+   i2cstat.lasterr = err;
+   printf("Error: I2C %s failure for register 0x%02X\n",
+          (err == I2C_ERR_WRITE) ? "write" : "read", wbuf[0]);
+   return(-err);
+}
+
+/* ------------------------------------------------------------ *
+ * xfer_recover() runs i2c_xfer(), and for one-shot commands    *
+ * like -d, -i and -r recovers the bus and tries once more.     *
+ * Returns 0, or the i2c_xfer() error.                          *
+ * ------------------------------------------------------------ */
+static int xfer_recover(char *wbuf, int wlen, void *rbuf, int rlen) {
+   int res = i2c_xfer(wbuf, wlen, rbuf, rlen);
+   if(res == 0 || i2c_recover() != 0) return(res);
+   return(i2c_xfer(wbuf, wlen, rbuf, rlen));
+}
+
 /* ------------------------------------------------------------ *
  * get_i2cbus() - Enables the I2C bus communication. RPi 2,3,4  *
  * use /dev/i2c-1, RPi 1 used i2c-0, NanoPi Neo also uses i2c-0 *
  * ------------------------------------------------------------ */
 void get_i2cbus(char *i2cbus, char *i2caddr) {
-
-   if((i2cfd = open(i2cbus, O_RDWR)) < 0) {
-      printf("Error failed to open I2C bus [%s].\n", i2cbus);
-      exit(-1);
-   }
+   strncpy(busname, i2cbus, sizeof(busname) - 1);
    if(verbose == 1) printf("Debug: I2C bus device: [%s]\n", i2cbus);
    /* --------------------------------------------------------- *
     * Set I2C device (MMC3416 I2C address is 0x30)              *
     * --------------------------------------------------------- */
-   int addr = (int)strtol(i2caddr, NULL, 16);
-   if(verbose == 1) printf("Debug: Sensor address: [0x%02X]\n", addr);
+   busaddr = (int)strtol(i2caddr, NULL, 16);
+   if(verbose == 1) printf("Debug: Sensor address: [0x%02X]\n", busaddr);
 
-   if(ioctl(i2cfd, I2C_SLAVE, addr) != 0) {
-      printf("Error can't find sensor at address [0x%02X].\n", addr);
+   if(i2c_open() != 0) {
+      printf("Error failed to open I2C bus [%s] for address [0x%02X].\n", i2cbus, busaddr);
       exit(-1);
    }
    /* --------------------------------------------------------- *
     * I2C communication test is the only way to confirm success *
     * --------------------------------------------------------- */
-   if(get_prdid(addr) == 0) {
-      printf("Error: No response from I2C. addr [0x%02X]?\n", addr);
+   if(get_prdid() == 0) {
+      printf("Error: No response from I2C. addr [0x%02X]?\n", busaddr);
       exit(-1);
    }
-   if(verbose == 1) printf("Debug: Got data @addr: [0x%02X]\n", addr);
+   if(verbose == 1) printf("Debug: Got data @addr: [0x%02X]\n", busaddr);
+}
+
+/* ------------------------------------------------------------ *
+ * i2c_recover() re-opens the I2C bus after persistent transfer *
+ * failures, and re-probes the sensor product id. The caller    *
+ * needs to restore the sensor mode, e.g. after a power glitch. *
+ * ------------------------------------------------------------ */
+int i2c_recover() {
+   double t0 = get_monotime();
+   int res = i2c_open();
+
+   i2cstat.recoveries++;
+   if(res == 0 && get_prdid() != PRD_ID) res = -I2C_ERR_BUS;
+   i2c_stall(t0);
+   if(res != 0) i2cstat.lasterr = I2C_ERR_BUS;
+   if(verbose == 1) printf("Debug: I2C bus recovery %s\n", res == 0 ? "done" : "failed");
+   return(res);
+}
+
+/* ------------------------------------------------------------ *
+ * i2c_report() prints the retry and recovery counters (Ex.):   *
+ * I2C: 52000 transfers, 3 retries, 0 recoveries, 0 invalid ... *
+ * ------------------------------------------------------------ */
+void i2c_report() {
+   printf("I2C: %ld transfers, %ld retries, %ld failures, %ld recoveries,"
+          " %ld invalid samples, stall %.1fms max %.1fms\n", i2c_xfers,
+          i2cstat.retries, i2cstat.failures, i2cstat.recoveries, i2cstat.invalid,
+          i2cstat.stall * 1000, i2cstat.maxstall * 1000);
 }
 
 /* --------------------------------------------------------------- *
@@ -61,56 +162,40 @@ void get_i2cbus(char *i2cbus, char *i2caddr) {
 char get_prdid() {
    char reg = MMC3416_PRODUCT_ID_ADDR;
    char buf = 0;
-   if(write(i2cfd, &reg, 1) != 1) {
-      printf("Error: I2C write failure for register 0x%02X\n", reg);
-   }
-
-   if(read(i2cfd, &buf, 1) != 1) {
-      printf("Error: I2C read failure for register 0x%02X\n", reg);
-   }
+   if(i2c_xfer(&reg, 1, &buf, 1) != 0) return(0);
    return buf;
 }
 
 /* --------------------------------------------------------------- *
  * mmc3416_set() initialize the magnetization in normal direction  *
  * --------------------------------------------------------------- */
-void mmc3416_set() {
+int mmc3416_set() {
    char  buf[2] = {MMC3416_CTL0_ADDR, 0x80}; // set bit-8 in reg 0x07
    if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
-   if(write(i2cfd, buf, 2) != 2) {
-      printf("Error: I2C write failure for register 0x%02X\n", buf[0]);
-      exit(-1);
-   }
+   if(i2c_xfer(buf, 2, NULL, 0) != 0) return(-1);
    delay(60);                    // wait >50ms for the CAP charge to finish
 
    buf[0] = MMC3416_CTL0_ADDR;   // ctl-0 register 0x07
    buf[1] = 0x20;                // bit-6: send SET CMD
    if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
-   if(write(i2cfd, buf, 2) != 2) {
-      printf("Error: I2C write failure for register 0x%02X\n", buf[0]);
-      exit(-1);
-   }
+   if(i2c_xfer(buf, 2, NULL, 0) != 0) return(-1);
+   return(0);
 }
 
 /* --------------------------------------------------------------- *
  * mmc3416_reset()  reverses magnetization (180 degrees opposed)   *
  * --------------------------------------------------------------- */
-void mmc3416_reset() {
+int mmc3416_reset() {
    char  buf[2] = {MMC3416_CTL0_ADDR, 0x80}; // set bit-8 in reg 0x07
    if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
-   if(write(i2cfd, buf, 2) != 2) {
-      printf("Error: I2C write failure for register 0x%02X\n", buf[0]);
-      exit(-1);
-   }
+   if(i2c_xfer(buf, 2, NULL, 0) != 0) return(-1);
    delay(60);                    // wait >50ms for the CAP charge to finish
 
    buf[0] = MMC3416_CTL0_ADDR;   // ctl-0 register 0x07
    buf[1] = 0x40;                // bit-6: send RESET CMD
    if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
-   if(write(i2cfd, buf, 2) != 2) {
-      printf("Error: I2C write failure for register 0x%02X\n", buf[0]);
-      exit(-1);
-   }
+   if(i2c_xfer(buf, 2, NULL, 0) != 0) return(-1);
+   return(0);
 }
 
 /* --------------------------------------------------------------- *
@@ -118,20 +203,20 @@ void mmc3416_reset() {
  * SET/RESET function for Null Field output temp compensation, and *
  * clears the sensor residual from strong external magnet exposure *
  * --------------------------------------------------------------- */
-void mmc3416_init(struct mmc3416data *mmc3416d) {
+int mmc3416_init(struct mmc3416data *mmc3416d) {
    float ds1[3] = {0, 0, 0};
    float ds2[3] = {0, 0, 0};
 
    if(verbose == 1) printf("Debug: mmc3416_init(): ...\n");
    offset[0] = 0; offset[1] = 0; offset[2] = 0; // clear offset
 
-   mmc3416_set();
+   if(mmc3416_set() != 0) return(-1);
    delay(10);
    /* ------------------------------------------------------------ *
     * The reading after at SET will contain the external magnetic  *
     * field data, plus the Offset: ds1 = +H + Offset               *
     * ------------------------------------------------------------ */
-   mmc3416_read(mmc3416d);
+   if(mmc3416_read(mmc3416d) != 0) return(-1);
    ds1[0] = mmc3416d->X;
    ds1[1] = mmc3416d->Y;
    ds1[2] = mmc3416d->Z;
@@ -139,13 +224,13 @@ void mmc3416_init(struct mmc3416data *mmc3416d) {
    /* ------------------------------------------------------------ *
     * Reset reverses magnetization (180 degrees opposed) to SET    *
     * ------------------------------------------------------------ */
-   mmc3416_reset();
+   if(mmc3416_reset() != 0) return(-1);
    delay(10);
    /* ------------------------------------------------------------ *
     * The reading after RESET will contain the reversed magnetic   *
     * field data, plus the Offset: ds1 = -H + Offset               *
     * ------------------------------------------------------------ */
-   mmc3416_read(mmc3416d);
+   if(mmc3416_read(mmc3416d) != 0) return(-1);
    ds2[0] = mmc3416d->X;
    ds2[1] = mmc3416d->Y;
    ds2[2] = mmc3416d->Z;
@@ -161,8 +246,9 @@ void mmc3416_init(struct mmc3416data *mmc3416d) {
    /* ------------------------------------------------------------ *
     * Set the magnetic orientation back to normal, and exit init() *
     * ------------------------------------------------------------ */
-   mmc3416_set();
+   if(mmc3416_set() != 0) return(-1);
    if(verbose == 1) printf("Debug: mmc3416_init(): done\n");
+   return(0);
 }
 
 /* --------------------------------------------------------------- *
@@ -178,15 +264,7 @@ int mmc3416_dump() {
     * ------------------------------------------------------ */
    char reg = 0x00;
    for(int i=0; i<9; i++) {
-      if(write(i2cfd, &reg, 1) != 1) {
-         printf("Error: I2C write failure for register 0x%02X\n", reg);
-         exit(-1);
-      }
-   
-      if(read(i2cfd, &buf1[i], 9) != 9) {
-         printf("Error: I2C read failure for register 0x%02X\n", reg);
-         exit(-1);
-      }
+      if(xfer_recover(&reg, 1, &buf1[i], 1) != 0) return(-1);
       reg++;
    }
 
@@ -195,15 +273,7 @@ int mmc3416_dump() {
     * ------------------------------------------------------ */
    reg = 0x1b;
    for(int i=0; i<5; i++) {
-      if(write(i2cfd, &reg, 1) != 1) {
-         printf("Error: I2C write failure for register 0x%02X\n", reg);
-         exit(-1);
-      }
-   
-      if(read(i2cfd, &buf2[i], 5) != 5) {
-         printf("Error: I2C read failure for register 0x%02X\n", reg);
-         exit(-1);
-      }
+      if(xfer_recover(&reg, 1, &buf2[i], 1) != 0) return(-1);
       reg++;
    }
 
@@ -211,15 +281,7 @@ int mmc3416_dump() {
     * Product ID register is located at 0x20.                *
     * ------------------------------------------------------ */
    reg = 0x20;
-   if(write(i2cfd, &reg, 1) != 1) {
-      printf("Error: I2C write failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
-
-   if(read(i2cfd, &buf3, 1) != 1) {
-      printf("Error: I2C read failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
+   if(xfer_recover(&reg, 1, &buf3, 1) != 0) return(-1);
 
    printf("------------------------------------------------------\n");
    printf("MEMSIC MMC3416xPJ register dump:\n");
@@ -268,7 +330,7 @@ int mmc3416_dump() {
       }
       printf(": 0x%02X 0b"BYTE_TO_BINARY_PATTERN"\n", buf1[i], BYTE_TO_BINARY(buf1[i]));
    }
-   exit(0);
+   return(0);
 }
 
 /* --------------------------------------------------------------- *
@@ -278,12 +340,9 @@ int mmc3416_swreset() {
    char data[2];
    data[0] = MMC3416_CTL1_ADDR;
    data[1] = 0xB6;
-   if(write(i2cfd, data, 2) != 2) {
-      printf("Error: I2C write failure for register 0x%02X\n", data[0]);
-      exit(-1);
-   }
+   if(xfer_recover(data, 2, NULL, 0) != 0) return(-1);
    if(verbose == 1) printf("Debug: Sensor SW Reset complete\n");
-   exit(0);
+   return(0);
 }
 
 /* ------------------------------------------------------------ *
@@ -294,37 +353,21 @@ int mmc3416_swreset() {
  * char boost_mode;  // reg 0x07 disable CAP charge pump bit-4  *
  * char outres_mode; // reg 0x08 output resolution mode bit-0,1 *
  * ------------------------------------------------------------ */
-void mmc3416_info(struct mmc3416inf *mmc3416i) {
+int mmc3416_info(struct mmc3416inf *mmc3416i) {
    mmc3416i->prd_id = get_prdid();
 
    /* Read MMC3416_CTL0_ADDR data */ 
    char reg = MMC3416_CTL0_ADDR;
-   if(write(i2cfd, &reg, 1) != 1) {
-      printf("Error: I2C write failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
-
-   if(read(i2cfd, &mmc3416i->ctl_0_mode, 1) != 1) {
-      printf("Error: I2C read failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
+   if(xfer_recover(&reg, 1, &mmc3416i->ctl_0_mode, 1) != 0) return(-1);
    if(verbose == 1) printf("Debug: Got ctl-0 byte: [0x%02X]\n",
                             mmc3416i->ctl_0_mode);
 
    /* Read MMC3416_CTL1_ADDR data */ 
    reg = MMC3416_CTL1_ADDR;
-   if(write(i2cfd, &reg, 1) != 1) {
-      printf("Error: I2C write failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
-
-   if(read(i2cfd, &mmc3416i->ctl_1_mode, 1) != 1) {
-      printf("Error: I2C read failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
+   if(xfer_recover(&reg, 1, &mmc3416i->ctl_1_mode, 1) != 0) return(-1);
    if(verbose == 1) printf("Debug: Got ctl-1 byte: [0x%02X]\n",
                             mmc3416i->ctl_1_mode);
-
+   return(0);
 }
 
 /* --------------------------------------------------------------- *
@@ -337,14 +380,7 @@ int set_cmfreq(int new_mode) {
    if(verbose == 1) printf("Debug: Set  Read Freq: [0x%02X]\n", new_mode);
    char reg = MMC3416_CTL0_ADDR;
    char regdata = 0;
-   if(write(i2cfd, &reg, 1) != 1) {
-      printf("Error: I2C write failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
-   if(read(i2cfd, &regdata, 1) != 1) {
-      printf("Error: I2C read failure for register 0x%02X\n", reg);
-      exit(-1);
-   }
+   if(i2c_xfer(&reg, 1, &regdata, 1) != 0) return(-1);
    if(verbose == 1) printf("Debug: Read data byte: [0x%02X] from [0x%02X]\n", regdata, reg);
 
    /* ---------------------------------------- */
@@ -356,7 +392,7 @@ int set_cmfreq(int new_mode) {
    /* ---------------------------------------- */
    /* Check if update is needed, or just exit  */
    /* ---------------------------------------- */
-   if(new_mode == current_mode) {
+   if(new_mode == current_mode && ((regdata >> 1) & 0x01) == 1) {
       if(verbose == 1) printf("Debug: New freq = current freq, no change.\n");
       return(0);
    }
@@ -392,22 +428,13 @@ int set_cmfreq(int new_mode) {
    buf[0] = reg;
    buf[1] = regdata;
    if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
-   if(write(i2cfd, buf, 2) != 2) {
-      printf("Error: I2C write failure for register 0x%02X\n", buf[0]);
-      return(-1);
-   }
+   if(i2c_xfer(buf, 2, NULL, 0) != 0) return(-1);
 
    /* ---------------------------------------- */
    /* read the changed data back from register */
    /* ---------------------------------------- */
-   if(write(i2cfd, &reg, 1) != 1) {
-      printf("Error: I2C write failure for register 0x%02X\n", reg);
-   }
-
    regdata = 0;
-   if(read(i2cfd, &regdata, 1) != 1) {
-      printf("Error: I2C read failure for register 0x%02X\n", reg);
-   }
+   if(i2c_xfer(&reg, 1, &regdata, 1) != 0) return(-1);
    if(verbose == 1) printf("Debug: Read data byte: [0x%02X] from [0x%02X]\n", regdata, reg);
    /* cont read frequency mode from reg 0x07 bit-2 and 3 */
    current_mode = ((regdata >> 2) & 0x03);
@@ -420,21 +447,56 @@ int set_cmfreq(int new_mode) {
 }
 
 
+/* --------------------------------------------------------------- *
+ * set_outres() set the output resolution bits in register 0x08.   *
+ * The register is only written if the resolution has changed.     *
+ * --------------------------------------------------------------- */
+int set_outres(int new_mode) {
+   char reg = MMC3416_CTL1_ADDR;
+   char regdata = 0;
+
+   if(verbose == 1) printf("Debug: Set Resolution: [0x%02X]\n", new_mode);
+   if(i2c_xfer(&reg, 1, &regdata, 1) != 0) return(-1);
+   if((regdata & 0x03) == new_mode) {
+      if(verbose == 1) printf("Debug: New resolution = current, no change.\n");
+      return(0);
+   }
+   char buf[2] = {0};
+   buf[0] = reg;
+   buf[1] = (regdata & ~0x83) | new_mode; // bit-0,1: BW, bit-7: no SW reset
+   if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
+   if(i2c_xfer(buf, 2, NULL, 0) != 0) return(-1);
+   return(0);
+}
+
 /* ------------------------------------------------------------ *
  *  mmc3416_read() - take a single data read over the XYZ axis  *
  *  convert to Milli Gauss, and store under the mmc3416 object. *
  * ------------------------------------------------------------ */
 int mmc3416_read(struct mmc3416data *mmc3416d) {
+   struct mmc3416sample s;
+
+   if(mmc3416_getsample(&s, 1) != 0) return(-1);
+   mmc3416_convert(&s);
+   *mmc3416d = s.data;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ *  sample_read() - wait for the measurement and read the raw   *
+ *  XYZ counts, returns 0 or the negative I2C_ERR_* class.      *
+ * ------------------------------------------------------------ */
+static int sample_read(struct mmc3416sample *s, int trigger) {
+   int res;
    /* ---------------------------------------- */
    /* Request new measurement through reg 0x07 */
    /* ---------------------------------------- */
-   char buf[2] = {0};
-   buf[0] = MMC3416_CTL0_ADDR;   // ctl-0 register 0x07
-   buf[1] = 0x01;                // bit-0: 1 request a new measurement
-   if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
-   if(write(i2cfd, buf, 2) != 2) {
-      printf("Error: I2C write failure for register 0x%02X\n", buf[0]);
-      return(-1);
+   if(trigger == 1) {
+      char buf[2] = {0};
+      buf[0] = MMC3416_CTL0_ADDR;   // ctl-0 register 0x07
+      buf[1] = 0x01;                // bit-0: 1 request a new measurement
+      if(verbose == 1) printf("Debug: Write databyte: [0x%02X] to   [0x%02X]\n", buf[1], buf[0]);
+      if((res = i2c_xfer(buf, 2, NULL, 0)) != 0) return(res);
    }
    if(verbose == 1) printf("Debug: Wait for measurement:\n");
 
@@ -443,18 +505,18 @@ int mmc3416_read(struct mmc3416data *mmc3416d) {
    /* ---------------------------------------- */
    char reg = MMC3416_STATUS_ADDR;
    char regdata = 0;
+   double tstart = get_monotime();
    while(1) {
-      if(write(i2cfd, &reg, 1) != 1) {
-         printf("Error: I2C write failure for register 0x%02X\n", reg);
-      }
-
-      if(read(i2cfd, &regdata, 1) != 1) {
-         printf("Error: I2C read failure for register 0x%02X\n", reg);
-      }
+      if((res = i2c_xfer(&reg, 1, &regdata, 1)) != 0) return(res);
       if(verbose == 1) printf("Debug: Read data byte: [0x%02X] from [0x%02X]\n", regdata, reg);
 
       if((regdata & 0x01) == 1) break; // if the last bit=1, data is ready
-      delay(10);                       // wait time
+      if(get_monotime() - tstart > I2C_READY_TIMEOUT) {
+         printf("Error: I2C sensor measurement timeout\n");
+         i2cstat.lasterr = I2C_ERR_TIMEOUT;
+         return(-I2C_ERR_TIMEOUT);
+      }
+      delay(trigger ? 10 : 1);         // wait time
    }
    if(verbose == 1) printf("Debug: measurement is ready.\n");
 
@@ -462,15 +524,12 @@ int mmc3416_read(struct mmc3416data *mmc3416d) {
    /* Data is ready to read from 0x00..0x05    */
    /* ---------------------------------------- */
    reg = MMC3416_XOUT_LSB_ADDR;
-   char measure[6] = {0, 0, 0, 0, 0, 0};
-   if(write(i2cfd, &reg, 1) != 1) {
-      printf("Error: I2C write failure for register 0x%02X\n", reg);
-   }
-   if(read(i2cfd, &measure, 6) != 6) {
-      printf("Error: I2C read failure for register 0x%02X\n", reg);
-   }
+   uint8_t measure[6] = {0, 0, 0, 0, 0, 0};
+   if((res = i2c_xfer(&reg, 1, &measure, 6)) != 0) return(res);
+   s->tread = get_monotime();
+   s->ts = get_time();
 
-   for(int i=0; i<7; i++) {
+   for(int i=0; i<6; i++) {
       if(verbose == 1) {
          printf("Debug: Read data byte: [0x%02X] from [0x%02X]\n", measure[i], reg+i);
       }
@@ -479,23 +538,204 @@ int mmc3416_read(struct mmc3416data *mmc3416d) {
    /* ---------------------------------------- */
    /* Combine LSB/MSB into 16-bit value X Y Z  */
    /* ---------------------------------------- */
-   uint16_t measured_data[3];
-   measured_data[0] = measure[1] << 8 | measure[0]; // X
-   measured_data[1] = measure[3] << 8 | measure[2]; // Y
-   measured_data[2] = measure[5] << 8 | measure[4]; // Z
+   s->raw[0] = measure[1] << 8 | measure[0]; // X
+   s->raw[1] = measure[3] << 8 | measure[2]; // Y
+   s->raw[2] = measure[5] << 8 | measure[4]; // Z
+   s->status = (uint8_t) regdata & ~SAMPLE_INVALID;
+   return(0);
+}
 
-   /* ---------------------------------------- */
-   /* Convert raw X Y Z data to milli Gauss    */
-   /* ---------------------------------------- */
-   mmc3416d->X = 0.48828125 * (float) measured_data[0] - offset[0];
-   mmc3416d->Y = 0.48828125 * (float) measured_data[1] - offset[1];
-   mmc3416d->Z = 0.48828125 * (float) measured_data[2] - offset[2];
-   if(verbose == 1) printf("Debug: Measured value: X-[%3.02f] Y-[%3.02f] Z-[%3.02f]\n",
-                            mmc3416d->X, mmc3416d->Y, mmc3416d->Z);
+/* ------------------------------------------------------------ *
+ * sample_fail() flags s as invalid with the error class res,   *
+ * counts it, and recovers the bus for the next try. Returns -1 *
+ * ------------------------------------------------------------ */
+static int sample_fail(struct mmc3416sample *s, int res) {
+   s->tread = get_monotime();
+   s->ts = get_time();
+   s->raw[0] = 0; s->raw[1] = 0; s->raw[2] = 0;
+   s->status = SAMPLE_INVALID | (uint8_t) -res;
+   i2cstat.invalid++;
+   i2cstat.consecutive++;
+   i2c_recover();
+   return(-1);
+}
+
+/* ------------------------------------------------------------ *
+ *  mmc3416_getsample() - wait for a measurement and read the   *
+ *  raw XYZ counts, status and timestamp into the sample. With  *
+ *  trigger=1 a new measurement is requested first, trigger=0   *
+ *  collects the next result in continuous read mode. If the    *
+ *  read fails after all retries, the sample is flagged with    *
+ *  SAMPLE_INVALID and the error class, the bus is recovered,   *
+ *  and -1 is returned. The caller restores the sensor mode.    *
+ * ------------------------------------------------------------ */
+int mmc3416_getsample(struct mmc3416sample *s, int trigger) {
+   int res = sample_read(s, trigger);
+   if(res == 0) {
+      i2cstat.consecutive = 0;
+      return(0);
+   }
+   return(sample_fail(s, res));
+}
+
+/* ------------------------------------------------------------ *
+ * Measurement time in microseconds, and the estimated RMS      *
+ * noise per sample in mGauss (datasheet noise, plus the        *
+ * quantization step) and the quantization step in counts for  *
+ * the ctl-1 BW bits 00..11.                                    *
+ * ------------------------------------------------------------ */
+static const long res_us[4] = { 7920, 4080, 2160, 1200 };
+static const float res_noise[4] = { 0.5, 0.6, 0.8, 2.3 };
+static const char *res_name[4] = { "16h", "16", "14", "12" };
+static const int res_step[4] = { 1, 1, 4, 16 };   // quantization step, counts
 
+/* ------------------------------------------------------------ *
+ * burst_outres() returns the fastest resolution whose noise    *
+ * over the burst meets the target, or the best one if none     *
+ * does. Without a target, the resolution stays (-1).           *
+ * ------------------------------------------------------------ */
+int burst_outres(struct mmc3416burst *b) {
+   if(b->target <= 0) return(-1);
+   for(int m=3; m>0; m--) {
+      if(res_noise[m] / sqrt(b->count) <= b->target) return(m);
+   }
    return(0);
 }
 
+/* ------------------------------------------------------------ *
+ * usleep_since() sleeps until us microseconds after t0.        *
+ * ------------------------------------------------------------ */
+static void usleep_since(double t0, long us) {
+   double left = t0 + us / 1e6 - get_monotime();
+   if(left <= 0) return;
+   struct timespec ts = { 0, (long) (left * 1e9) };
+   nanosleep(&ts, NULL);
+}
+
+/* ------------------------------------------------------------ *
+ *  mmc3416_burst() - takes b->count triggered measurements and *
+ *  averages them into s. The next measurement is triggered     *
+ *  before the data of the previous one is read, so the I2C     *
+ *  read overlaps the sensor conversion time. The averaged      *
+ *  X Y Z in s->data keep the sub-LSB precision, s->ts is the   *
+ *  burst midpoint. Returns 0, or -I2C_ERR_* on I2C errors.     *
+ * ------------------------------------------------------------ */
+static int burst_run(struct mmc3416burst *b, struct mmc3416sample *s) {
+   char trig[2] = {MMC3416_CTL0_ADDR, 0x01}; // bit-0: request a measurement
+   char sreg = MMC3416_STATUS_ADDR;
+   char dreg = MMC3416_XOUT_LSB_ADDR;
+   char status = 0;
+   uint8_t measure[6];
+   int ref[3] = {0, 0, 0};
+   double sum[3] = {0, 0, 0}, sumsq[3] = {0, 0, 0};
+   int m = (b->outres < 0) ? 0 : b->outres;      // sensor default is 16h
+   long wait = res_us[m];
+
+   double t0 = get_monotime();
+   double ttrig = t0;
+   b->done = 0;
+   int res = i2c_xfer(trig, 2, NULL, 0);
+   if(res != 0) return(res);
+
+   for(int n=0; n<b->count; n++) {
+      /* ---------------------------------------- */
+      /* wait out the conversion, then poll ready */
+      /* ---------------------------------------- */
+      usleep_since(ttrig, wait);
+      while(1) {
+         if((res = i2c_xfer(&sreg, 1, &status, 1)) != 0) return(res);
+         if((status & 0x01) == 1) break;
+         if(get_monotime() - ttrig > I2C_READY_TIMEOUT) {
+            printf("Error: I2C sensor measurement timeout\n");
+            i2cstat.lasterr = I2C_ERR_TIMEOUT;
+            return(-I2C_ERR_TIMEOUT);
+         }
+         usleep_since(get_monotime(), 100);
+      }
+      /* ---------------------------------------- */
+      /* start the next one, then read this one   */
+      /* ---------------------------------------- */
+      if(n + 1 < b->count) {
+         ttrig = get_monotime();
+         if((res = i2c_xfer(trig, 2, NULL, 0)) != 0) return(res);
+      }
+      if((res = i2c_xfer(&dreg, 1, measure, 6)) != 0) return(res);
+
+      /* sums relative to the first sample, to keep the variance exact */
+      for(int a=0; a<3; a++) {
+         int v = measure[2*a+1] << 8 | measure[2*a];
+         if(n == 0) ref[a] = v;
+         double d = v - ref[a];
+         sum[a] += d;
+         sumsq[a] += d * d;
+      }
+      b->done++;
+   }
+   b->wall = get_monotime() - t0;
+   s->tread = get_monotime();
+   s->ts = get_time() - b->wall / 2;
+   s->status = (uint8_t) status & ~SAMPLE_INVALID;
+
+   float v[3];
+   int n = b->done;
+   for(int a=0; a<3; a++) {
+      double mean = sum[a] / n;
+      double var = (n > 1) ? (sumsq[a] - sum[a] * mean) / (n - 1) : 0;
+      s->raw[a] = (uint16_t) lround(ref[a] + mean);
+      v[a] = 0.48828125 * (ref[a] + mean) - offset[a];
+      b->sem[a] = 0.48828125 * sqrt((var > 0 ? var : 0) / n);
+      /* quantized samples can have zero spread, the mean is still */
+      /* only known to the quantization noise step/sqrt(12n)       */
+      double qfloor = 0.48828125 * res_step[m] / sqrt(12.0 * n);
+      if(b->sem[a] < qfloor) b->sem[a] = qfloor;
+   }
+   s->data.X = v[0];
+   s->data.Y = v[1];
+   s->data.Z = v[2];
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ *  mmc3416_burst() - runs the burst. A failed burst is handled *
+ *  like a failed sample: s is flagged SAMPLE_INVALID, counted, *
+ *  and the bus is recovered for the next try. Returns 0 or -1. *
+ * ------------------------------------------------------------ */
+int mmc3416_burst(struct mmc3416burst *b, struct mmc3416sample *s) {
+   int res = burst_run(b, s);
+   if(res == 0) {
+      i2cstat.consecutive = 0;
+      return(0);
+   }
+   return(sample_fail(s, res));
+}
+
+/* ------------------------------------------------------------ *
+ * burst_report() prints the burst result (Example):            *
+ * Burst: 64 samples 14 bit, 103.4ms, stderr X=0.07 Y=0.07 ...  *
+ * ------------------------------------------------------------ */
+void burst_report(struct mmc3416burst *b) {
+   printf("Burst: %d samples %s bit, %.1fms, stderr X=%.3f Y=%.3f Z=%.3f mGauss",
+          b->done, (b->outres < 0) ? "default" : res_name[b->outres], b->wall * 1000,
+          b->sem[0], b->sem[1], b->sem[2]);
+   if(b->target > 0) {
+      float worst = fmaxf(b->sem[0], fmaxf(b->sem[1], b->sem[2]));
+      printf(", target %.3f %s", b->target, (worst <= b->target) ? "met" : "missed");
+   }
+   printf("\n");
+}
+
+/* ------------------------------------------------------------ *
+ *  mmc3416_convert() - convert the raw X Y Z counts of a live  *
+ *  or replayed sample to milli Gauss, minus the sensor offset. *
+ * ------------------------------------------------------------ */
+void mmc3416_convert(struct mmc3416sample *s) {
+   s->data.X = 0.48828125 * (float) s->raw[0] - offset[0];
+   s->data.Y = 0.48828125 * (float) s->raw[1] - offset[1];
+   s->data.Z = 0.48828125 * (float) s->raw[2] - offset[2];
+   if(verbose == 1) printf("Debug: Measured value: X-[%3.02f] Y-[%3.02f] Z-[%3.02f]\n",
+                            s->data.X, s->data.Y, s->data.Z);
+}
+
 /* ------------------------------------------------------- */
 /* get_heading() convert two-axis value to compass heading */
 /* ------------------------------------------------------- */
@@ -558,3 +798,21 @@ int delay(long msec) {
 
    return res;
 }
+
+/* ------------------------------------------------------- */
+/* get_time() returns the wall clock time in seconds.      */
+/* ------------------------------------------------------- */
+double get_time() {
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/* ------------------------------------------------------- */
+/* get_monotime() monotonic clock in seconds, for latency  */
+/* ------------------------------------------------------- */
+double get_monotime() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
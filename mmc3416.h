@@ -1,6 +1,8 @@
 /* ------------------------------------------------------------ *
  * file:        mmc3416.h                                       *
- * purpose:     header file for getmmc3416.c and i2c_mmc3416.c  *
+ * purpose:     header file for getmmc3416.c, i2c_mmc3416.c and *
+ *              the feature modules <name>_mmc3416.c, e.g.      *
+ *              replay, filter, calib, output and ring.         *
  *                                                              *
  * author:      09/04/2021 Frank4DD                             *
  * ------------------------------------------------------------ */
@@ -48,10 +50,13 @@
 /* ------------------------------------------------------------ *
  * global variables                                             *
  * ------------------------------------------------------------ */
-int i2cfd;             // I2C file descriptor
-int verbose;           // debug flag, 0 = normal, 1 = debug mode
-float offset[3];       // sensor axis offset values
-float declination;     // local declination value
+extern int i2cfd;             // I2C file descriptor
+extern int verbose;           // debug flag, 0 = normal, 1 = debug mode
+extern float offset[3];       // sensor axis offset values
+extern float declination;     // local declination value
+extern long i2c_xfers;        // I2C transfer counter, incl. retries
+extern struct mmc3416i2cstat i2cstat; // I2C retry and recovery counters
+extern const float cm_hz[4];  // continuous read frequency per mode
 
 /* ------------------------------------------------------------ *
  * MMC3416 status and control data structure                      *
@@ -71,18 +76,510 @@ struct mmc3416data{
    float Z;        // Z component
 };
 
+/* ------------------------------------------------------------ *
+ * MMC3416 sample record, as it passes through the processing   *
+ * pipeline. Live reads and replayed recordings both fill the   *
+ * raw counts and timestamp, the pipeline does the rest.        *
+ * ------------------------------------------------------------ */
+struct mmc3416sample{
+   double ts;                // sample time, seconds since epoch
+   double tread;             // monotonic time of the data read
+   uint16_t raw[3];          // raw X Y Z register counts
+   uint8_t status;           // status register 0x06 at read time
+   struct mmc3416data data;  // converted X Y Z in milli Gauss
+   float heading;            // compass heading in degrees
+};
+
+/* ------------------------------------------------------------ *
+ * I2C error handling: each transfer is retried with a doubling *
+ * backoff, persistent failures re-open the bus and re-probe    *
+ * the sensor. Samples that could not be read are kept with the *
+ * SAMPLE_INVALID status bit and the error class in bits 0..2.  *
+ * ------------------------------------------------------------ */
+#define I2C_ERR_WRITE       1  // register address or data write failed
+#define I2C_ERR_READ        2  // register read failed
+#define I2C_ERR_TIMEOUT     3  // measurement did not become ready
+#define I2C_ERR_BUS         4  // bus open or sensor probe failed
+#define I2C_MAXRETRY        3  // retries per transfer
+#define I2C_BACKOFF_MS      1  // first retry delay, doubles per retry
+#define I2C_READY_TIMEOUT 2.0  // max seconds to wait for data ready
+#define I2C_MAXFAIL        10  // failed samples in a row before giving up
+#define SAMPLE_INVALID   0x80  // status flag: no valid data in this sample
+
+struct mmc3416i2cstat{
+   long retries;            // transfers repeated after a failure
+   long failures;           // transfers failed after all retries
+   long recoveries;         // bus re-opens with sensor re-probe
+   long invalid;            // samples flagged SAMPLE_INVALID
+   int consecutive;         // invalid samples in a row
+   int lasterr;             // last error class, I2C_ERR_*
+   double stall;            // seconds spent in retries and recoveries
+   double maxstall;         // longest single stall in seconds
+};
+
+/* ------------------------------------------------------------ *
+ * Burst oversampling for -t: N triggered measurements back to  *
+ * back, averaged into one sample. Without a -m resolution, the *
+ * fastest mode whose noise meets the standard error target is  *
+ * used.                                                        *
+ * ------------------------------------------------------------ */
+#define BURST_MAX    1024   // max measurements per burst
+
+struct mmc3416burst{
+   int count;               // measurements to average, 0 = no burst
+   float target;            // standard error target in mGauss, 0 = none
+   int outres;              // output resolution BW bits, -1 = unchanged
+   int done;                // measurements taken
+   float sem[3];            // standard error of the mean per axis, mGauss
+   double wall;             // burst wall time in seconds
+};
+
+/* ------------------------------------------------------------ *
+ * Shared result cache for -t: a lock on the I2C bus device and *
+ * a result file per user and bus, with the last measurement    *
+ * and its burst settings.                                      *
+ * ------------------------------------------------------------ */
+#define CACHE_DIR       "/tmp"     // directory for the cache files
+#define CACHEMAGIC      "MMC3416C" // cache file magic
+#define CACHEVERSION            1  // cache file version
+#define CACHE_LOCKWAIT       10.0  // max seconds to wait for the bus lock
+
+struct mmc3416cache{
+   char magic[8];           // CACHEMAGIC, not zero-terminated
+   uint32_t version;        // CACHEVERSION
+   double stored;           // time the result was stored
+   struct mmc3416sample sample;  // the measurement
+   struct mmc3416burst burst;    // burst settings and statistics
+};
+
+/* ------------------------------------------------------------ *
+ * Streaming filter chain, applied to the X Y Z vector before   *
+ * the heading is calculated. Each output has its own chain.    *
+ * ------------------------------------------------------------ */
+#define FILTER_MAXSTAGE  8  // max number of chained filter stages
+#define FILTER_MAXWIN   64  // max average/median window, CIC ratio
+#define FILTER_MAXCIC    4  // max CIC filter order
+#define FILTER_AVG       1  // moving average
+#define FILTER_IIR       2  // 1st order IIR low-pass
+#define FILTER_MED       3  // moving median
+#define FILTER_CIC       4  // CIC decimator
+
+struct mmc3416stage{
+   int type;                          // FILTER_AVG .. FILTER_CIC
+   int len;                           // window length or CIC ratio
+   int order;                         // CIC order
+   float alpha;                       // IIR smoothing factor
+   double gain;                       // CIC gain ratio^order
+   int count;                         // window fill, CIC phase
+   int pos;                           // window ring buffer position
+   int primed;                        // CIC outputs since start
+   float ring[3][FILTER_MAXWIN];      // avg/med window values
+   float sorted[3][FILTER_MAXWIN];    // med window, sorted
+   double sum[3];                     // avg window running sum
+   float y[3];                        // IIR filter state
+   uint64_t integ[3][FILTER_MAXCIC];  // CIC integrators
+   uint64_t comb[3][FILTER_MAXCIC];   // CIC comb delays
+};
+
+struct mmc3416filter{
+   int nstage;                        // number of active stages
+   struct mmc3416stage stage[FILTER_MAXSTAGE];
+};
+
+/* ------------------------------------------------------------ *
+ * Hard- and soft-iron calibration: corrected = matrix * (v -   *
+ * bias). The fit keeps the running sums of the 9-parameter     *
+ * ellipsoid least squares problem instead of the samples.      *
+ * ------------------------------------------------------------ */
+#define CAL_NPARAM 9        // ellipsoid fit parameters
+
+struct mmc3416cal{
+   int valid;               // 1 = calibration loaded or solved
+   float bias[3];           // hard-iron bias in milli Gauss
+   float matrix[3][3];      // soft-iron correction matrix
+   float radius;            // mean field strength in milli Gauss
+   float residual;          // RMS algebraic fit residual
+};
+
+struct mmc3416calfit{
+   long count;                          // samples added to the fit
+   double ata[CAL_NPARAM][CAL_NPARAM];  // sum of D'D, upper triangle
+   double atb[CAL_NPARAM];              // sum of D'1
+   float min[3];                        // per axis min, for coverage
+   float max[3];                        // per axis max, for coverage
+};
+
+/* ------------------------------------------------------------ *
+ * Windowed statistics (rollup) of the sample stream. axis[] is *
+ * X, Y, Z and field magnitude, heading uses circular sums.     *
+ * ------------------------------------------------------------ */
+#define MAXROLLUP 4         // max number of rollup windows
+
+struct mmc3416welford{
+   double mean;             // running mean
+   double m2;               // running sum of squared differences
+   double min;              // window minimum
+   double max;              // window maximum
+};
+
+struct mmc3416rollup{
+   int len;                 // window length in seconds
+   double start;            // window start time, seconds since epoch
+   long count;              // samples in the window
+   struct mmc3416welford axis[4]; // X, Y, Z, magnitude
+   double sumsin;           // sum of heading sin()
+   double sumcos;           // sum of heading cos()
+};
+
+/* ------------------------------------------------------------ *
+ * Adaptive continuous read frequency state and statistics      *
+ * ------------------------------------------------------------ */
+#define ADAPT_BASE        0.5  // min seconds for a rate of change
+
+struct mmc3416adapt{
+   int enabled;             // 1 = adaptive mode is on
+   float up;                // step up threshold, mGauss/s
+   float down;              // quiet threshold, mGauss/s
+   float quiet;             // quiet seconds before stepping down
+   int minmode;             // lowest cont read mode (-c)
+   int mode;                // current cont read mode
+   int havelast;            // 1 = last[] holds the reference sample
+   uint16_t last[3];        // reference raw X Y Z sample
+   double lastts;           // reference sample time
+   double tstart;           // adaptive mode start time
+   double tmode;            // time of the last mode switch
+   double tquiet;           // time of the last non-quiet sample
+   double tinmode[4];       // seconds spent in each mode
+   long samples[4];         // samples taken in each mode
+   int switches;            // number of mode switches
+   long xfers0;             // i2c_xfers at start
+};
+
+/* ------------------------------------------------------------ *
+ * Change-point event detector state (CUSUM over the deviation  *
+ * from a slow baseline) and event emission latency statistics. *
+ * ------------------------------------------------------------ */
+struct mmc3416event{
+   int enabled;             // 1 = event detection is on
+   float k;                 // drift allowance, mGauss
+   float h;                 // CUSUM threshold, mGauss
+   float hold;              // quiet seconds that end an event
+   char cmd[256];           // command to run per event
+   char fifo[256];          // FIFO to write events into
+   int fifofd;              // FIFO file descriptor, -1 = closed
+   long count;              // samples seen
+   double tfirst;           // time of the first sample
+   double tlast;            // time of the previous sample
+   float base[4];           // baseline X, Y, Z, magnitude
+   double cusum;            // CUSUM statistic
+   int active;              // 1 = inside an event
+   double tstart;           // event start time
+   double tquiet;           // last time the deviation exceeded k
+   float peak;              // max deviation inside the event
+   long events;             // number of detected events
+   long emitted;            // number of emitted start/end records
+   double latmin;           // min read to emit latency, seconds
+   double latmax;           // max read to emit latency, seconds
+   double latsum;           // sum of read to emit latencies
+};
+
+/* ------------------------------------------------------------ *
+ * Streaming Allan deviation at octave tau = 2^k samples. Each  *
+ * level keeps a ring of the running sum, taken every stride    *
+ * samples, with stride = m/ALLAN_OVERLAP for large m.          *
+ * ------------------------------------------------------------ */
+#define ALLAN_MAXTAU   28   // max tau levels, 2^27 samples ~31 days
+#define ALLAN_OVERLAP   4   // ring entries per tau, sets the overlap
+#define ALLAN_RING      (2 * ALLAN_OVERLAP + 1)
+
+struct mmc3416avar{
+   long m;                  // tau in samples
+   long stride;             // samples between ring entries
+   int lag;                 // ring entries per tau, m/stride
+   int pos;                 // ring write position
+   int fill;                // ring entries filled
+   double ring[3][ALLAN_RING]; // running sums X(n) per axis
+   double sumsq[3];         // sum of squared 2nd differences
+   long terms;              // number of summed differences
+};
+
+struct mmc3416allan{
+   int enabled;             // 1 = Allan deviation mode is on
+   int ntau;                // number of tau levels
+   long count;              // samples seen
+   double tfirst;           // time of the first sample
+   double tlast;            // time of the last sample
+   float y0[3];             // first sample, removed from the sums
+   double sum[3];           // running sum per axis
+   struct mmc3416avar level[ALLAN_MAXTAU];
+};
+
+/* ------------------------------------------------------------ *
+ * Spectral analysis: sliding Goertzel tones and windowed FFT.  *
+ * ------------------------------------------------------------ */
+#define SPEC_N        256   // FFT and sliding window size, power of 2
+#define SPEC_MAXTONE    8   // max number of Goertzel frequencies
+#define SPEC_PEAKS      3   // number of FFT peaks reported per axis
+
+struct mmc3416tone{
+   float freq;              // configured frequency in Hz
+   float alias;             // frequency aliased into 0..fs/2
+   double wr, wi;           // e^(jw)
+   double wnr, wni;         // e^(jwN)
+   double gr, gi;           // DC gain, sum of e^(jwi)
+   double sr[3], si[3];     // sliding DFT value per axis
+};
+
+struct mmc3416spec{
+   int enabled;             // 1 = spectral analysis is on
+   int ntone;               // number of Goertzel frequencies
+   struct mmc3416tone tone[SPEC_MAXTONE];
+   float ring[3][SPEC_N];   // last SPEC_N samples per axis
+   double sum[3];           // window sum per axis
+   int pos;                 // ring write position
+   long count;              // samples seen
+   double tfirst;           // time of the first sample
+   float fs;                // measured sample rate, 0 = unknown
+   float hann[SPEC_N];      // Hann window
+   float twr[SPEC_N/2];     // FFT twiddle factors, real
+   float twi[SPEC_N/2];     // FFT twiddle factors, imaginary
+   float re[SPEC_N];        // FFT work buffer, real
+   float im[SPEC_N];        // FFT work buffer, imaginary
+};
+
+/* ------------------------------------------------------------ *
+ * Output sinks: text, CSV, JSON-lines or HTML table, each with *
+ * its own filter chain and a preallocated line buffer.         *
+ * ------------------------------------------------------------ */
+#define MAXSINK         8   // max number of -o output sinks
+#define SINK_TEXT       0   // "ts X= Y= Z= Heading=" text lines
+#define SINK_CSV        1   // CSV with header line
+#define SINK_JSON       2   // one JSON object per line
+#define SINK_HTML       3   // HTML table with the latest sample
+#define SINK_BUFSIZE 16384  // line buffer per sink
+#define SINK_MAXLINE  256   // max length of one formatted line
+#define SINK_INTERVAL 1.0   // max seconds between buffer flushes
+
+struct mmc3416sink{
+   char spec[288];          // -o argument, matched on reconfiguration
+   int type;                // SINK_TEXT, SINK_CSV, SINK_JSON, SINK_HTML
+   char path[256];          // output file, "-" = stdout
+   char tmppath[272];       // HTML temp file, renamed to path
+   int fd;                  // output file descriptor, -1 = closed
+   double interval;         // flush interval in seconds, 0 = each line
+   double tflush;           // monotonic time of the last flush
+   int len;                 // bytes in buf
+   long count;              // lines written
+   int havelatest;          // 1 = HTML table has a new sample
+   struct mmc3416sample latest; // HTML: latest sample, formatted at flush
+   struct mmc3416filter filter; // filter chain for this sink
+   char buf[SINK_BUFSIZE];  // formatted lines waiting for the flush
+};
+
+/* ------------------------------------------------------------ *
+ * Live configuration, read from the -C file at the start and   *
+ * on SIGHUP. Unset values (-1, have* = 0) stay unchanged.      *
+ * ------------------------------------------------------------ */
+struct mmc3416conf{
+   int cmfreq;              // continuous read mode 0..3, -1 = unset
+   int outres;              // output resolution BW bits, -1 = unset
+   int havedecl;            // 1 = declination is set
+   float declination;       // local declination value
+   int havefilter;          // 1 = filter is set, "none" = no filter
+   char filterspec[256];    // filter chain spec for the stdout output
+   struct mmc3416filter filter;
+   int haveoutput;          // 1 = output list is set
+   int nsink;               // number of outputs
+   struct mmc3416sink sink[MAXSINK];
+};
+
+/* ------------------------------------------------------------ *
+ * Replay source for recorded raw samples. Recordings are CSV   *
+ * text "ts,x,y,z,status" or binary (RECMAGIC header, followed  *
+ * by fixed size records), both optionally with sensor offsets. *
+ * ------------------------------------------------------------ */
+#define RECMAGIC       "MMC3416R"  // binary recording file magic
+#define RECVERSION              1  // binary recording file version
+
+struct mmc3416rechdr{
+   char magic[8];      // RECMAGIC, not zero-terminated
+   uint32_t version;   // RECVERSION
+   uint32_t reclen;    // size of one mmc3416rec record
+   float offset[3];    // sensor offset at recording time
+   uint32_t reserved;  // pad header to 32 bytes
+};
+
+struct mmc3416rec{
+   double ts;          // sample time, seconds since epoch
+   uint16_t raw[3];    // raw X Y Z register counts
+   uint8_t status;     // status register 0x06
+   uint8_t flags;      // reserved, written as 0
+};
+
+struct mmc3416replay{
+   FILE *fp;           // recording file handle
+   int binary;         // 0 = CSV text, 1 = binary records
+   int pace;           // 1 = replay at recorded pace
+   long line;          // current line or record number
+   double t0;          // timestamp of the first sample
+   double wall0;       // wall clock time at the first sample
+};
+
+/* ------------------------------------------------------------ *
+ * Flight recorder: memory-mapped ring file of the last N raw   *
+ * samples. Record sequence numbers start at 1, 0 = empty slot. *
+ * ------------------------------------------------------------ */
+#define RINGMAGIC      "MMC3416F"  // ring file magic
+#define RINGVERSION             2  // ring file version, 2 = record offsets
+#define RING_SLOTS          30000  // default records, 10min at 50Hz
+#define RING_MAXSLOTS     1000000  // max records, 40MB mapped
+
+struct mmc3416ringhdr{
+   char magic[8];      // RINGMAGIC, not zero-terminated
+   uint32_t version;   // RINGVERSION
+   uint32_t reclen;    // size of one mmc3416ringrec record
+   uint32_t slots;     // number of records in the ring
+   uint32_t reserved0; // align seq
+   uint64_t seq;       // last written sequence number
+   uint8_t reserved[32]; // pad header to 64 bytes
+};
+
+struct mmc3416ringrec{
+   uint64_t seq;       // sequence number, 0 while being written
+   struct mmc3416rec rec; // the raw sample
+   float offset[3];    // sensor offset of the run that wrote it
+   uint32_t reserved;  // pad record to 40 bytes
+};
+
+struct mmc3416ring{
+   int fd;             // ring file handle
+   uint32_t slots;     // number of records in the ring
+   uint64_t seq;       // last written sequence number
+   size_t len;         // mapped file size
+   struct mmc3416ringhdr *hdr; // mapped file header
+   struct mmc3416ringrec *rec; // mapped records
+};
+
 /* ------------------------------------------------------------ *
  * external function prototypes for I2C bus communication       *
  * ------------------------------------------------------------ */
 extern void get_i2cbus(char*, char*);         // get the I2C bus file handle
-extern void mmc3416_set();                    // charge CAP and execute SET
-extern void mmc3416_reset();                  // charge CAP and execute RESET
+extern int i2c_recover();                     // re-open bus, re-probe sensor
+extern void i2c_report();                     // print retry/recovery counters
+extern int mmc3416_set();                     // charge CAP and execute SET
+extern int mmc3416_reset();                   // charge CAP and execute RESET
 extern int mmc3416_swreset();                 // SW reset clears registers
-extern void mmc3416_init();                   // initialize the sensor
+extern int mmc3416_init();                    // initialize the sensor
 extern int mmc3416_dump();                    // dump the register map data
-extern void mmc3416_info(struct mmc3416inf*); // print sensor information
+extern int mmc3416_info(struct mmc3416inf*);  // read sensor information
 extern char get_prdid();                      // get the sensor product id
 extern int set_cmfreq(int);                   // set continuous read frequency
+extern int set_outres(int);                   // set output resolution mode
+extern int burst_outres(struct mmc3416burst*); // pick burst resolution
+extern int mmc3416_burst(struct mmc3416burst*, struct mmc3416sample*);
+extern void burst_report(struct mmc3416burst*); // print burst statistics
 extern int mmc3416_read();                    // read sensor data
 extern float get_heading();                   // calculate heading from raw data
 extern int delay(long msec);                  // create a Arduino-style delay
+extern int mmc3416_getsample(struct mmc3416sample*, int); // read raw sample
+extern void mmc3416_convert(struct mmc3416sample*); // raw counts to mGauss
+extern double get_time();                     // wall clock in seconds
+extern double get_monotime();                 // monotonic clock in seconds
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for the sample filter chain     *
+ * ------------------------------------------------------------ */
+extern int filter_parse(char*, struct mmc3416filter*); // parse filter spec
+extern int filter_run(struct mmc3416filter*, struct mmc3416data*); // filter
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for hard/soft-iron calibration  *
+ * ------------------------------------------------------------ */
+extern void calib_add(struct mmc3416calfit*, struct mmc3416data*); // add data
+extern int calib_solve(struct mmc3416calfit*, struct mmc3416cal*); // fit it
+extern void calib_apply(struct mmc3416cal*, struct mmc3416data*); // correct
+extern int calib_save(char*, struct mmc3416cal*); // write calibration file
+extern int calib_load(char*, struct mmc3416cal*); // read calibration file
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for windowed statistics         *
+ * ------------------------------------------------------------ */
+extern void welford_add(struct mmc3416welford*, long, double); // add value
+extern void rollup_init(struct mmc3416rollup*, int); // set window length
+extern int rollup_add(struct mmc3416rollup*, struct mmc3416sample*,
+                      struct mmc3416rollup*);   // add sample, get closed
+extern int rollup_flush(struct mmc3416rollup*, struct mmc3416rollup*);
+extern double rollup_variance(struct mmc3416rollup*, int); // axis variance
+extern double rollup_heading(struct mmc3416rollup*, double*); // circ. mean
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for adaptive read frequency     *
+ * ------------------------------------------------------------ */
+extern int adapt_parse(char*, struct mmc3416adapt*); // parse -a spec
+extern void adapt_start(struct mmc3416adapt*, int, double); // start mode
+extern int adapt_setmin(struct mmc3416adapt*, int, double); // new low mode
+extern int adapt_update(struct mmc3416adapt*, struct mmc3416sample*);
+extern void adapt_report(struct mmc3416adapt*, double); // print stats
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for the change-point detector   *
+ * ------------------------------------------------------------ */
+extern int event_parse(char*, struct mmc3416event*); // parse -e spec
+extern void event_update(struct mmc3416event*, struct mmc3416sample*);
+extern void event_report(struct mmc3416event*); // print event statistics
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for Allan deviation analysis    *
+ * ------------------------------------------------------------ */
+extern void allan_init(struct mmc3416allan*, int); // setup tau levels
+extern void allan_add(struct mmc3416allan*, struct mmc3416sample*);
+extern void allan_print(struct mmc3416allan*); // print the ADEV table
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for spectral analysis           *
+ * ------------------------------------------------------------ */
+extern int spec_parse(char*, struct mmc3416spec*); // parse -S frequencies
+extern void spec_add(struct mmc3416spec*, struct mmc3416sample*);
+extern void spec_reset(struct mmc3416spec*); // restart on a rate change
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for the output sinks            *
+ * ------------------------------------------------------------ */
+extern int sink_parse(char*, struct mmc3416sink*); // parse -o argument
+extern int sink_open(struct mmc3416sink*, char*); // open, optional suffix
+extern void sink_write(struct mmc3416sink*, struct mmc3416sample*);
+extern int sink_flush(struct mmc3416sink*);   // write buffered lines
+extern void sink_close(struct mmc3416sink*);  // flush and close
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for the -t result cache         *
+ * ------------------------------------------------------------ */
+extern int bus_lock(char*);                   // lock the I2C bus device
+extern void bus_unlock(int);                  // unlock for the next caller
+extern int cache_open(char*);                 // open the user's result file
+extern int cache_get(int, double, struct mmc3416burst*, struct mmc3416sample*);
+extern void cache_put(int, struct mmc3416burst*, struct mmc3416sample*);
+extern void cache_close(int);                 // close the result file
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for the live configuration      *
+ * ------------------------------------------------------------ */
+extern int outres_parse(char*);               // -m argument to BW bits
+extern int config_load(char*, struct mmc3416conf*); // read -C config file
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for sample recording and replay *
+ * ------------------------------------------------------------ */
+extern int replay_open(char*, int, struct mmc3416replay*); // open recording
+extern int replay_next(struct mmc3416replay*, struct mmc3416sample*);
+extern void replay_close(struct mmc3416replay*); // close the recording
+extern FILE *record_open(char*, int);         // create a new recording
+extern int record_write(FILE*, int, struct mmc3416sample*); // add a sample
+
+/* ------------------------------------------------------------ *
+ * external function prototypes for the flight recorder ring    *
+ * ------------------------------------------------------------ */
+extern int ring_open(char*, uint32_t, struct mmc3416ring*); // map ring file
+extern void ring_write(struct mmc3416ring*, struct mmc3416sample*);
+extern void ring_close(struct mmc3416ring*);  // sync and unmap the ring
+extern int ring_dump(char*);                  // ring to stdout, time order
@@ -0,0 +1,280 @@
+/* ------------------------------------------------------------ *
+ * file:        output_mmc3416.c                                *
+ * purpose:     Buffered output sinks for the MMC3416 sample    *
+ *              stream: text lines, CSV, JSON-lines and an HTML *
+ *              table. Each sink has its own filter chain and a *
+ *              preallocated buffer, numbers are formatted with *
+ *              a fixed-precision formatter instead of printf,  *
+ *              and lines are flushed in batches with writev(). *
+ *              The HTML table is a snapshot of the latest data *
+ *              which is only formatted when it is written to a *
+ *              temp file and renamed, so a web server never    *
+ *              reads a half-written file.                      *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "mmc3416.h"
+
+static const char csvhead[] = "ts,x_mgauss,y_mgauss,z_mgauss,heading_deg\n";
+
+static const char htmhead[] = "<!DOCTYPE html>\n<html>\n<head>\n"
+   "<meta http-equiv=\"refresh\" content=\"5\">\n"
+   "<title>MMC3416 Sensor Data</title>\n</head>\n<body>\n"
+   "<table border=\"1\">\n<tr><th colspan=\"5\">MEMSIC MMC3416 Magnetic Field Sensor</th></tr>\n"
+   "<tr><th>Time</th><th>X [mGauss]</th><th>Y [mGauss]</th>"
+   "<th>Z [mGauss]</th><th>Heading [deg]</th></tr>\n";
+static const char htmfoot[] = "</table>\n</body>\n</html>\n";
+
+/* ------------------------------------------------------------ *
+ * fmt_fixed() writes v with dec decimals (0..6) into p, and    *
+ * returns the number of characters. v * 10^dec is rounded to   *
+ * the nearest integer, ties to even. Unlike printf, this works *
+ * on the scaled double, so a value within a rounding error of  *
+ * a tie can differ in the last digit, and there is no "-0.00". *
+ * ------------------------------------------------------------ */
+static int fmt_fixed(char *p, double v, int dec) {
+   static const double scale[7] = { 1, 10, 100, 1e3, 1e4, 1e5, 1e6 };
+   char tmp[32];
+   int n = 0, len = 0, neg = 0;
+
+   if(v != v) { memcpy(p, "nan", 3); return(3); }
+   if(v < 0) { neg = 1; v = -v; }
+   if(v > 9e12) v = 9e12;                       // keep within uint64_t
+   double x = v * scale[dec];
+   uint64_t u = (uint64_t) x;
+   double frac = x - u;
+   if(frac > 0.5 || (frac == 0.5 && (u & 1))) u++;
+   if(neg && u > 0) p[len++] = '-';             // no "-0.00"
+   for(int i=0; i<dec; i++) { tmp[n++] = '0' + u % 10; u /= 10; }
+   if(dec > 0) tmp[n++] = '.';
+   do { tmp[n++] = '0' + u % 10; u /= 10; } while(u > 0);
+   while(n > 0) p[len++] = tmp[--n];
+   return(len);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_parse() reads an -o argument: [csv:|json:|text:]path    *
+ * with an optional filter chain after '@'. A path without type *
+ * is an HTML table file. Path "-" writes to stdout.            *
+ * ------------------------------------------------------------ */
+int sink_parse(char *arg, struct mmc3416sink *k) {
+   char *filter;
+
+   memset(k, 0, sizeof(struct mmc3416sink));
+   if(strlen(arg) >= sizeof(k->spec)) {
+      printf("Error: output argument to long.\n");
+      return(-1);
+   }
+   strncpy(k->spec, arg, sizeof(k->spec));
+   k->fd = -1;
+   k->type = SINK_HTML;
+   if(strncmp(arg, "csv:", 4) == 0) { k->type = SINK_CSV; arg += 4; }
+   else if(strncmp(arg, "json:", 5) == 0) { k->type = SINK_JSON; arg += 5; }
+   else if(strncmp(arg, "text:", 5) == 0) { k->type = SINK_TEXT; arg += 5; }
+   else if(strncmp(arg, "html:", 5) == 0) { arg += 5; }
+
+   if(strlen(arg) >= sizeof(k->path)) {
+      printf("Error: output file argument to long.\n");
+      return(-1);
+   }
+   strncpy(k->path, arg, sizeof(k->path));
+   if((filter = strchr(k->path, '@')) != NULL) {
+      *filter++ = '\0';
+      if(filter_parse(filter, &k->filter) != 0) return(-1);
+   }
+   if(k->path[0] == '\0') {
+      printf("Error: output needs a file name, or - for stdout.\n");
+      return(-1);
+   }
+   if(k->type == SINK_HTML && strcmp(k->path, "-") == 0) {
+      printf("Error: HTML output needs a file name.\n");
+      return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_open() opens the sink file. suffix, if set, is appended *
+ * to the file name, e.g. for parallel replay workers.          *
+ * ------------------------------------------------------------ */
+int sink_open(struct mmc3416sink *k, char *suffix) {
+   if(suffix != NULL && strcmp(k->path, "-") != 0) {
+      size_t len = strlen(k->path);
+      snprintf(k->path + len, sizeof(k->path) - len, ".%s", suffix);
+   }
+   k->len = 0;
+   k->tflush = 0;
+   k->count = 0;
+   k->havelatest = 0;
+
+   if(k->type == SINK_HTML) {
+      snprintf(k->tmppath, sizeof(k->tmppath), "%s.tmp", k->path);
+      k->interval = SINK_INTERVAL;
+      return(0);
+   }
+   if(strcmp(k->path, "-") == 0) {
+      k->fd = STDOUT_FILENO;
+      k->interval = isatty(STDOUT_FILENO) ? 0 : SINK_INTERVAL;
+   }
+   else {
+      k->fd = open(k->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(k->fd < 0) {
+         printf("Error: could not create output file [%s]: %s\n", k->path, strerror(errno));
+         return(-1);
+      }
+      k->interval = SINK_INTERVAL;
+   }
+   if(k->type == SINK_CSV) {
+      memcpy(k->buf, csvhead, sizeof(csvhead) - 1);
+      k->len = sizeof(csvhead) - 1;
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * html_row() formats the table row of the latest sample.       *
+ * ------------------------------------------------------------ */
+static void html_row(struct mmc3416sink *k) {
+   struct mmc3416sample *s = &k->latest;
+   char date[32], *p = k->buf;
+   time_t t = (time_t) s->ts;
+   struct tm tm;
+
+   strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+   p += snprintf(p, SINK_MAXLINE, "<tr><td>%s</td><td>", date);
+   p += fmt_fixed(p, s->data.X, 2); memcpy(p, "</td><td>", 9); p += 9;
+   p += fmt_fixed(p, s->data.Y, 2); memcpy(p, "</td><td>", 9); p += 9;
+   p += fmt_fixed(p, s->data.Z, 2); memcpy(p, "</td><td>", 9); p += 9;
+   p += fmt_fixed(p, s->heading, 1); memcpy(p, "</td></tr>\n", 11); p += 11;
+   k->len = p - k->buf;
+}
+
+/* ------------------------------------------------------------ *
+ * sink_flush() writes the buffered lines. Stream sinks write   *
+ * the buffer, the HTML sink formats the row of the latest      *
+ * sample, writes head, row and foot with a single writev()     *
+ * into a temp file, then renames it in place.                  *
+ * ------------------------------------------------------------ */
+int sink_flush(struct mmc3416sink *k) {
+   struct iovec iov[3];
+   int iovcnt = 0, fd = k->fd;
+   ssize_t want = 0;
+
+   if(k->type == SINK_HTML) {
+      if(k->havelatest == 0) return(0);
+      html_row(k);
+      fd = open(k->tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(fd < 0) {
+         printf("Error: could not create output file [%s]: %s\n", k->tmppath, strerror(errno));
+         return(-1);
+      }
+      iov[iovcnt].iov_base = (void *) htmhead; iov[iovcnt++].iov_len = sizeof(htmhead) - 1;
+      iov[iovcnt].iov_base = k->buf;           iov[iovcnt++].iov_len = k->len;
+      iov[iovcnt].iov_base = (void *) htmfoot; iov[iovcnt++].iov_len = sizeof(htmfoot) - 1;
+   }
+   else {
+      if(k->len == 0 || fd < 0) return(0);
+      if(fd == STDOUT_FILENO) fflush(stdout);   // keep stdio text in order
+      iov[iovcnt].iov_base = k->buf; iov[iovcnt++].iov_len = k->len;
+   }
+   for(int i=0; i<iovcnt; i++) want += iov[i].iov_len;
+
+   ssize_t res = writev(fd, iov, iovcnt);
+   while(res > 0 && res < want) {              // rare short write
+      ssize_t done = res;
+      want -= done;
+      for(int i=0; i<iovcnt && done > 0; i++) {
+         size_t d = ((size_t) done < iov[i].iov_len) ? (size_t) done : iov[i].iov_len;
+         iov[i].iov_base = (char *) iov[i].iov_base + d;
+         iov[i].iov_len -= d;
+         done -= d;
+      }
+      res = writev(fd, iov, iovcnt);
+   }
+   if(k->type == SINK_HTML) {
+      close(fd);
+      if(res < 0 || rename(k->tmppath, k->path) != 0) {
+         printf("Error: could not write output file [%s]: %s\n", k->path, strerror(errno));
+         unlink(k->tmppath);
+         return(-1);
+      }
+      k->havelatest = 0;
+      return(0);
+   }
+   k->len = 0;
+   if(res < 0) {
+      printf("Error: could not write output [%s]: %s\n", k->path, strerror(errno));
+      return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_write() formats one sample into the sink buffer, and    *
+ * flushes when the buffer is full or the interval has passed.  *
+ * ------------------------------------------------------------ */
+void sink_write(struct mmc3416sink *k, struct mmc3416sample *s) {
+   if(k->type != SINK_HTML && k->len > SINK_BUFSIZE - SINK_MAXLINE) sink_flush(k);
+
+   char *p = k->buf + k->len;
+   switch(k->type) {
+      case SINK_TEXT:
+         /* 1634960403.120 X=-81.05 Y=52.73 Z=-399.41 Heading=326.0 degrees */
+         p += fmt_fixed(p, s->ts, 3);
+         memcpy(p, " X=", 3); p += 3; p += fmt_fixed(p, s->data.X, 2);
+         memcpy(p, " Y=", 3); p += 3; p += fmt_fixed(p, s->data.Y, 2);
+         memcpy(p, " Z=", 3); p += 3; p += fmt_fixed(p, s->data.Z, 2);
+         memcpy(p, " Heading=", 9); p += 9; p += fmt_fixed(p, s->heading, 1);
+         memcpy(p, " degrees\n", 9); p += 9;
+         break;
+
+      case SINK_CSV:
+         p += fmt_fixed(p, s->ts, 3);    *p++ = ',';
+         p += fmt_fixed(p, s->data.X, 2); *p++ = ',';
+         p += fmt_fixed(p, s->data.Y, 2); *p++ = ',';
+         p += fmt_fixed(p, s->data.Z, 2); *p++ = ',';
+         p += fmt_fixed(p, s->heading, 1); *p++ = '\n';
+         break;
+
+      case SINK_JSON:
+         memcpy(p, "{\"ts\":", 6); p += 6;        p += fmt_fixed(p, s->ts, 3);
+         memcpy(p, ",\"x\":", 5); p += 5;         p += fmt_fixed(p, s->data.X, 2);
+         memcpy(p, ",\"y\":", 5); p += 5;         p += fmt_fixed(p, s->data.Y, 2);
+         memcpy(p, ",\"z\":", 5); p += 5;         p += fmt_fixed(p, s->data.Z, 2);
+         memcpy(p, ",\"heading\":", 11); p += 11; p += fmt_fixed(p, s->heading, 1);
+         memcpy(p, "}\n", 2); p += 2;
+         break;
+
+      case SINK_HTML:
+         /* the table shows the latest sample, formatted at flush */
+         k->latest = *s;
+         k->havelatest = 1;
+         break;
+   }
+   k->len = p - k->buf;
+   k->count++;
+
+   if(s->tread - k->tflush >= k->interval) {
+      k->tflush = s->tread;
+      sink_flush(k);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * sink_close() flushes the remaining data and closes the file  *
+ * ------------------------------------------------------------ */
+void sink_close(struct mmc3416sink *k) {
+   sink_flush(k);
+   if(k->fd >= 0 && k->fd != STDOUT_FILENO) close(k->fd);
+   k->fd = -1;
+}
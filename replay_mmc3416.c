@@ -0,0 +1,181 @@
+/* ------------------------------------------------------------ *
+ * file:        replay_mmc3416.c                                *
+ * purpose:     Record raw MMC3416 samples to file, and replay  *
+ *              recordings through the processing pipeline.     *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *              Functions are called from getmmc3416.c.         *
+ *                                                              *
+ * format:      CSV text, one sample per line: ts,x,y,z,status  *
+ *              x,y,z are raw register counts, a line starting  *
+ *              with "# offset x y z" sets the sensor offset in *
+ *              milli Gauss. Binary files start with a struct   *
+ *              mmc3416rechdr, followed by struct mmc3416rec.   *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * replay_open() opens a recording, detects the file format and *
+ * loads the recorded sensor offset. pace=1 replays the samples *
+ * at the recorded speed, pace=0 as fast as possible.           *
+ * ------------------------------------------------------------ */
+int replay_open(char *file, int pace, struct mmc3416replay *rp) {
+   memset(rp, 0, sizeof(struct mmc3416replay));
+   rp->pace = pace;
+
+   if(strcmp(file, "-") == 0) rp->fp = stdin;
+   else rp->fp = fopen(file, "r");
+   if(rp->fp == NULL) {
+      printf("Error: could not open replay file [%s].\n", file);
+      return(-1);
+   }
+   /* ---------------------------------------------------------- *
+    * Binary recordings start with the magic, CSV does not       *
+    * ---------------------------------------------------------- */
+   int c = getc(rp->fp);
+   if(c == EOF) return(0);
+   ungetc(c, rp->fp);
+   if(c != RECMAGIC[0]) return(0);
+
+   struct mmc3416rechdr hdr;
+   if(fread(&hdr, sizeof(hdr), 1, rp->fp) != 1
+      || memcmp(hdr.magic, RECMAGIC, sizeof(hdr.magic)) != 0) {
+      printf("Error: [%s] is not a MMC3416 recording.\n", file);
+      replay_close(rp);
+      return(-1);
+   }
+   if(hdr.version != RECVERSION || hdr.reclen != sizeof(struct mmc3416rec)) {
+      printf("Error: [%s] unsupported recording version %u.\n", file, hdr.version);
+      replay_close(rp);
+      return(-1);
+   }
+   rp->binary = 1;
+   for(int i=0; i<3; i++) offset[i] = hdr.offset[i];
+   if(verbose == 1) printf("Debug: Replay binary [%s] offset X-[%3.02f] Y-[%3.02f] Z-[%3.02f]\n",
+                            file, offset[0], offset[1], offset[2]);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * replay_wait() holds the replay back to the recorded pace.    *
+ * ------------------------------------------------------------ */
+static void replay_wait(struct mmc3416replay *rp, double ts) {
+   double now = get_time();
+   if(rp->wall0 == 0) {
+      rp->t0 = ts;
+      rp->wall0 = now;
+      return;
+   }
+   double ahead = (ts - rp->t0) - (now - rp->wall0);
+   if(ahead > 0.001) delay((long) (ahead * 1000));
+}
+
+/* ------------------------------------------------------------ *
+ * replay_next() gets the next recorded sample. Returns 1 for a *
+ * sample, 0 at the end of the recording, -1 on format errors.  *
+ * ------------------------------------------------------------ */
+int replay_next(struct mmc3416replay *rp, struct mmc3416sample *s) {
+   memset(s, 0, sizeof(struct mmc3416sample));
+
+   if(rp->binary == 1) {
+      struct mmc3416rec rec;
+      if(fread(&rec, sizeof(rec), 1, rp->fp) != 1) return(0);
+      rp->line++;
+      s->ts = rec.ts;
+      for(int i=0; i<3; i++) s->raw[i] = rec.raw[i];
+      s->status = rec.status;
+   }
+   else {
+      char line[256];
+      while(1) {
+         if(fgets(line, sizeof(line), rp->fp) == NULL) return(0);
+         rp->line++;
+         if(line[0] == '#') {
+            float o[3];
+            if(sscanf(line, "# offset %f %f %f", &o[0], &o[1], &o[2]) == 3) {
+               for(int i=0; i<3; i++) offset[i] = o[i];
+            }
+            continue;
+         }
+         if(line[0] == '\n' || line[0] == '\r' || line[0] == '\0') continue;
+         break;
+      }
+      char *p = line, *end;
+      s->ts = strtod(p, &end);
+      for(int i=0; i<3; i++) {
+         if(end == p || *end != ',') {
+            printf("Error: replay format error in line %ld.\n", rp->line);
+            return(-1);
+         }
+         p = end + 1;
+         s->raw[i] = (uint16_t) strtoul(p, &end, 10);
+      }
+      if(end == p) {
+         printf("Error: replay format error in line %ld.\n", rp->line);
+         return(-1);
+      }
+      if(*end == ',') s->status = (uint8_t) strtoul(end + 1, NULL, 10);
+   }
+
+   if(rp->pace == 1) replay_wait(rp, s->ts);
+   s->tread = get_monotime();
+   return(1);
+}
+
+/* ------------------------------------------------------------ *
+ * replay_close() closes the recording file                     *
+ * ------------------------------------------------------------ */
+void replay_close(struct mmc3416replay *rp) {
+   if(rp->fp != NULL && rp->fp != stdin) fclose(rp->fp);
+   rp->fp = NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * record_open() creates a new recording with the current       *
+ * sensor offset. binary=1 writes records, binary=0 CSV text.   *
+ * ------------------------------------------------------------ */
+FILE *record_open(char *file, int binary) {
+   FILE *fp = fopen(file, "w");
+   if(fp == NULL) {
+      printf("Error: could not create record file [%s].\n", file);
+      return(NULL);
+   }
+   if(binary == 1) {
+      struct mmc3416rechdr hdr;
+      memset(&hdr, 0, sizeof(hdr));
+      memcpy(hdr.magic, RECMAGIC, sizeof(hdr.magic));
+      hdr.version = RECVERSION;
+      hdr.reclen = sizeof(struct mmc3416rec);
+      for(int i=0; i<3; i++) hdr.offset[i] = offset[i];
+      fwrite(&hdr, sizeof(hdr), 1, fp);
+   }
+   else {
+      fprintf(fp, "# offset %f %f %f\n", offset[0], offset[1], offset[2]);
+   }
+   return(fp);
+}
+
+/* ------------------------------------------------------------ *
+ * record_write() appends one raw sample to the recording       *
+ * ------------------------------------------------------------ */
+int record_write(FILE *fp, int binary, struct mmc3416sample *s) {
+   if(binary == 1) {
+      struct mmc3416rec rec;
+      rec.ts = s->ts;
+      for(int i=0; i<3; i++) rec.raw[i] = s->raw[i];
+      rec.status = s->status;
+      rec.flags = 0;
+      if(fwrite(&rec, sizeof(rec), 1, fp) != 1) return(-1);
+   }
+   else {
+      if(fprintf(fp, "%.6f,%u,%u,%u,%u\n", s->ts, s->raw[0], s->raw[1],
+                 s->raw[2], s->status) < 0) return(-1);
+   }
+   return(0);
+}
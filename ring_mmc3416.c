@@ -0,0 +1,217 @@
+/* ------------------------------------------------------------ *
+ * file:        ring_mmc3416.c                                  *
+ * purpose:     Flight recorder for the last N raw samples: a   *
+ *              fixed size, memory-mapped ring file. The read   *
+ *              loop stores each sample with plain memory       *
+ *              writes, no system call per sample, and the disk *
+ *              usage never grows. The kernel page cache keeps  *
+ *              the data if the program crashes. Each record    *
+ *              carries its sequence number, which is cleared   *
+ *              while the record is written, so a crash in the  *
+ *              middle of a write leaves one skipped record,    *
+ *              never a wrong one. A restart continues the old  *
+ *              ring, and keeps the samples from before a crash *
+ *              with the sensor offset of the run that recorded *
+ *              them. ring_dump() writes the ring in time order *
+ *              as CSV recording that can be replayed with -p.  *
+ *              Record writes and reads are ordered by fences,  *
+ *              so -X can read the ring of a running recorder,  *
+ *              also on weakly ordered CPUs like the Pi's ARM.  *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * ring_valid() checks the ring header against the file size.   *
+ * ------------------------------------------------------------ */
+static int ring_valid(struct mmc3416ringhdr *hdr, off_t size) {
+   if(size < (off_t) sizeof(struct mmc3416ringhdr)) return(0);
+   if(memcmp(hdr->magic, RINGMAGIC, sizeof(hdr->magic)) != 0) return(0);
+   if(hdr->version != RINGVERSION) return(0);
+   if(hdr->reclen != sizeof(struct mmc3416ringrec) || hdr->slots == 0) return(0);
+   return(size == (off_t) (sizeof(struct mmc3416ringhdr)
+                           + (off_t) hdr->slots * sizeof(struct mmc3416ringrec)));
+}
+
+/* ------------------------------------------------------------ *
+ * ring_last() returns the highest sequence number in the ring. *
+ * The records are checked, as the header may lag after a crash *
+ * ------------------------------------------------------------ */
+static uint64_t ring_last(struct mmc3416ringhdr *hdr, struct mmc3416ringrec *rec) {
+   uint64_t last = 0;
+   for(uint32_t i=0; i<hdr->slots; i++) {
+      uint64_t seq = __atomic_load_n(&rec[i].seq, __ATOMIC_ACQUIRE);
+      if(seq > last && (seq - 1) % hdr->slots == i) last = seq;
+   }
+   return(last);
+}
+
+/* ------------------------------------------------------------ *
+ * ring_open() maps the ring file with the given number of      *
+ * records. An existing valid ring is continued with its own    *
+ * number of records, it is never truncated. Any other file is  *
+ * created new with empty records.                              *
+ * ------------------------------------------------------------ */
+int ring_open(char *file, uint32_t slots, struct mmc3416ring *r) {
+   struct stat st;
+   struct mmc3416ringhdr hdr;
+
+   memset(r, 0, sizeof(struct mmc3416ring));
+   r->fd = open(file, O_RDWR | O_CREAT, 0644);
+   if(r->fd < 0 || fstat(r->fd, &st) != 0) {
+      printf("Error: could not open ring file [%s]: %s\n", file, strerror(errno));
+      return(-1);
+   }
+
+   int reuse = 0;
+   if(pread(r->fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)
+      && ring_valid(&hdr, st.st_size)) {
+      if(hdr.slots != slots)
+         printf("Ring: [%s] keeps its %u records, remove it to resize to %u.\n",
+                file, hdr.slots, slots);
+      slots = hdr.slots;
+      reuse = 1;
+   }
+   /* the whole file is mapped, it must fit the address space */
+   uint64_t len = sizeof(struct mmc3416ringhdr) + (uint64_t) slots * sizeof(struct mmc3416ringrec);
+   if(slots > RING_MAXSLOTS || len > SIZE_MAX || (uint64_t) (off_t) len != len) {
+      printf("Error: ring file [%s] with %u records is too large.\n", file, slots);
+      close(r->fd);
+      return(-1);
+   }
+   r->len = (size_t) len;
+   if(reuse == 0) {
+      /* truncate to 0 first, so that all records read back as empty */
+      if(ftruncate(r->fd, 0) != 0 || ftruncate(r->fd, r->len) != 0) {
+         printf("Error: could not size ring file [%s]: %s\n", file, strerror(errno));
+         close(r->fd);
+         return(-1);
+      }
+   }
+   void *map = mmap(NULL, r->len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+   if(map == MAP_FAILED) {
+      printf("Error: could not map ring file [%s]: %s\n", file, strerror(errno));
+      close(r->fd);
+      return(-1);
+   }
+   r->hdr = map;
+   r->rec = (struct mmc3416ringrec *) ((char *) map + sizeof(struct mmc3416ringhdr));
+   r->slots = slots;
+
+   if(reuse == 0) {
+      memcpy(r->hdr->magic, RINGMAGIC, sizeof(r->hdr->magic));
+      r->hdr->version = RINGVERSION;
+      r->hdr->reclen = sizeof(struct mmc3416ringrec);
+      r->hdr->slots = slots;
+   }
+   r->seq = ring_last(r->hdr, r->rec);
+   r->hdr->seq = r->seq;
+   if(verbose == 1) printf("Debug: Ring [%s] %u records, %s at sequence %llu\n", file,
+                            slots, reuse ? "continued" : "created", (unsigned long long) r->seq);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * ring_write() stores one raw sample, memory writes only. The  *
+ * record sequence is zero while the record is written: the     *
+ * release fence keeps the data stores after the zeroing, the   *
+ * release store of the new sequence keeps them before it.      *
+ * ------------------------------------------------------------ */
+void ring_write(struct mmc3416ring *r, struct mmc3416sample *s) {
+   uint64_t seq = r->seq + 1;
+   struct mmc3416ringrec *rec = &r->rec[(seq - 1) % r->slots];
+   uint8_t flags = 0;
+
+   __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   __atomic_store(&rec->rec.ts, &s->ts, __ATOMIC_RELAXED);
+   for(int i=0; i<3; i++) {
+      __atomic_store(&rec->rec.raw[i], &s->raw[i], __ATOMIC_RELAXED);
+      __atomic_store(&rec->offset[i], &offset[i], __ATOMIC_RELAXED);
+   }
+   __atomic_store(&rec->rec.status, &s->status, __ATOMIC_RELAXED);
+   __atomic_store(&rec->rec.flags, &flags, __ATOMIC_RELAXED);
+   __atomic_store_n(&rec->seq, seq, __ATOMIC_RELEASE);
+   __atomic_store_n(&r->hdr->seq, seq, __ATOMIC_RELEASE);
+   r->seq = seq;
+}
+
+/* ------------------------------------------------------------ *
+ * ring_close() writes the mapped pages to disk, and unmaps it. *
+ * ------------------------------------------------------------ */
+void ring_close(struct mmc3416ring *r) {
+   if(r->hdr == NULL) return;
+   msync(r->hdr, r->len, MS_SYNC);
+   munmap(r->hdr, r->len);
+   close(r->fd);
+   r->hdr = NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * ring_dump() writes the records of a ring file to stdout in   *
+ * time order, as CSV recording "ts,x,y,z,status". A "# offset" *
+ * line starts the records of each run. Works on the ring of a  *
+ * crashed, or of a still running program: a record is used if  *
+ * its sequence is the same before and after the data reads.    *
+ * ------------------------------------------------------------ */
+int ring_dump(char *file) {
+   struct stat st;
+   struct mmc3416sample s;
+   float o[3], last_o[3] = {0, 0, 0};
+   long count = 0, skipped = 0;
+   int haveo = 0;
+
+   int fd = open(file, O_RDONLY);
+   if(fd < 0 || fstat(fd, &st) != 0) {
+      printf("Error: could not open ring file [%s].\n", file);
+      return(-1);
+   }
+   void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if(map == MAP_FAILED || !ring_valid(map, st.st_size)) {
+      printf("Error: invalid ring file [%s].\n", file);
+      if(map != MAP_FAILED) munmap(map, st.st_size);
+      return(-1);
+   }
+   struct mmc3416ringhdr *hdr = map;
+   struct mmc3416ringrec *rec = (struct mmc3416ringrec *) ((char *) map + sizeof(*hdr));
+
+   uint64_t last = ring_last(hdr, rec);
+   uint64_t first = (last > hdr->slots) ? last - hdr->slots + 1 : 1;
+   memset(&s, 0, sizeof(s));
+   for(uint64_t seq=first; seq<=last && last > 0; seq++) {
+      struct mmc3416ringrec *rp = &rec[(seq - 1) % hdr->slots];
+      if(__atomic_load_n(&rp->seq, __ATOMIC_ACQUIRE) != seq) { skipped++; continue; }
+      __atomic_load(&rp->rec.ts, &s.ts, __ATOMIC_RELAXED);
+      for(int i=0; i<3; i++) {
+         __atomic_load(&rp->rec.raw[i], &s.raw[i], __ATOMIC_RELAXED);
+         __atomic_load(&rp->offset[i], &o[i], __ATOMIC_RELAXED);
+      }
+      __atomic_load(&rp->rec.status, &s.status, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if(__atomic_load_n(&rp->seq, __ATOMIC_RELAXED) != seq) { skipped++; continue; }
+      if(haveo == 0 || memcmp(o, last_o, sizeof(o)) != 0) {
+         printf("# offset %f %f %f\n", o[0], o[1], o[2]);
+         memcpy(last_o, o, sizeof(o));
+         haveo = 1;
+      }
+      record_write(stdout, 0, &s);
+      count++;
+   }
+   printf("# ring %u records, sequence %llu..%llu, %ld samples, %ld skipped\n",
+          hdr->slots, (unsigned long long) first, (unsigned long long) last, count, skipped);
+   munmap(map, st.st_size);
+   return(0);
+}
@@ -0,0 +1,219 @@
+/* ------------------------------------------------------------ *
+ * file:        spectrum_mmc3416.c                              *
+ * purpose:     Streaming spectral analysis of the MMC3416 data *
+ *              to detect mains and motor interference, which   *
+ *              aliases into the sensor sample rate. Runs two   *
+ *              analysers on each axis, next to the normal data *
+ *              output:                                         *
+ *              - sliding Goertzel (sliding DFT) filters at the *
+ *                configured frequencies, updated every sample  *
+ *                with O(1) cost per frequency                  *
+ *              - a Hann-windowed FFT over the last SPEC_N      *
+ *                samples, once every SPEC_N samples, reporting *
+ *                the RMS and the strongest spectral peaks      *
+ *              The sample rate is measured from the first      *
+ *              SPEC_N timestamps, so replayed data works too.  *
+ *              Tones aliasing to 0 Hz (e.g. 50 Hz mains at the *
+ *              50 Hz rate) can't be told apart from the field. *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * spec_parse() reads the comma-separated list of frequencies   *
+ * in Hz for the sliding Goertzel filters, e.g. "50,60,100".    *
+ * ------------------------------------------------------------ */
+int spec_parse(char *spec, struct mmc3416spec *sp) {
+   char *p = spec, *end;
+
+   memset(sp, 0, sizeof(struct mmc3416spec));
+   while(*p != '\0') {
+      double f = strtod(p, &end);
+      if(end == p || f < 0 || sp->ntone == SPEC_MAXTONE) {
+         printf("Error: spectrum needs up to %d frequencies >= 0 Hz.\n", SPEC_MAXTONE);
+         return(-1);
+      }
+      sp->tone[sp->ntone++].freq = f;
+      p = (*end == ',') ? end + 1 : end;
+   }
+   /* Hann window and FFT twiddle factors */
+   for(int i=0; i<SPEC_N; i++) sp->hann[i] = 0.5 - 0.5 * cos(2 * M_PI * i / SPEC_N);
+   for(int i=0; i<SPEC_N/2; i++) {
+      sp->twr[i] = cos(2 * M_PI * i / SPEC_N);
+      sp->twi[i] = -sin(2 * M_PI * i / SPEC_N);
+   }
+   sp->enabled = 1;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * spec_reset() restarts the analysis after a sample rate       *
+ * change: the window is refilled, and the rate measured again. *
+ * ------------------------------------------------------------ */
+void spec_reset(struct mmc3416spec *sp) {
+   memset(sp->ring, 0, sizeof(sp->ring));
+   memset(sp->sum, 0, sizeof(sp->sum));
+   sp->pos = 0;
+   sp->count = 0;
+   sp->tfirst = 0;
+   sp->fs = 0;
+}
+
+/* ------------------------------------------------------------ *
+ * spec_start() sets the tone filter coefficients once the rate *
+ * is known, and primes them from the filled sample window.     *
+ * The recurrence for S(n) = sum x(n-i) * e^(jwi), i=0..N-1 is: *
+ * S(n) = x(n) + e^(jw) * S(n-1) - x(n-N) * e^(jwN)             *
+ * ------------------------------------------------------------ */
+static void spec_start(struct mmc3416spec *sp) {
+   for(int t=0; t<sp->ntone; t++) {
+      struct mmc3416tone *tn = &sp->tone[t];
+      /* fold the frequency into 0..fs/2, where it shows up */
+      tn->alias = fabs(tn->freq - sp->fs * round(tn->freq / sp->fs));
+      double w = 2 * M_PI * tn->alias / sp->fs;
+      tn->wr = cos(w);      tn->wi = sin(w);
+      tn->wnr = cos(w * SPEC_N); tn->wni = sin(w * SPEC_N);
+      /* DC gain sum e^(jwi): the window mean is removed with it */
+      tn->gr = 0; tn->gi = 0;
+      for(int i=0; i<SPEC_N; i++) { tn->gr += cos(w * i); tn->gi += sin(w * i); }
+      for(int a=0; a<3; a++) {
+         tn->sr[a] = 0; tn->si[a] = 0;
+         for(int i=0; i<SPEC_N; i++) {
+            float x = sp->ring[a][(sp->pos - 1 - i + 2 * SPEC_N) % SPEC_N];
+            tn->sr[a] += x * cos(w * i);
+            tn->si[a] += x * sin(w * i);
+         }
+      }
+      if(verbose == 1) printf("Debug: Spectrum tone %.2f Hz aliases to %.2f Hz at fs %.2f Hz\n",
+                               tn->freq, tn->alias, sp->fs);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * fft() in-place radix-2 FFT over SPEC_N points                *
+ * ------------------------------------------------------------ */
+static void fft(struct mmc3416spec *sp, float *re, float *im) {
+   for(int i=1, j=0; i<SPEC_N; i++) {          // bit reversal
+      int bit = SPEC_N >> 1;
+      for(; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+      if(i < j) {
+         float t = re[i]; re[i] = re[j]; re[j] = t;
+         t = im[i]; im[i] = im[j]; im[j] = t;
+      }
+   }
+   for(int len=2; len<=SPEC_N; len<<=1) {
+      int step = SPEC_N / len;
+      for(int i=0; i<SPEC_N; i+=len) {
+         for(int k=0; k<len/2; k++) {
+            float wr = sp->twr[k * step], wi = sp->twi[k * step];
+            int u = i + k, v = i + k + len/2;
+            float xr = re[v] * wr - im[v] * wi;
+            float xi = re[v] * wi + im[v] * wr;
+            re[v] = re[u] - xr; im[v] = im[u] - xi;
+            re[u] += xr;        im[u] += xi;
+         }
+      }
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * spec_report() prints the tone amplitudes and, per axis, the  *
+ * RMS and strongest peaks of the windowed FFT. Amplitudes are  *
+ * sine peak values in milli Gauss.                             *
+ * ------------------------------------------------------------ */
+static void spec_report(struct mmc3416spec *sp, double ts) {
+   static const char axisname[3] = { 'X', 'Y', 'Z' };
+
+   for(int t=0; t<sp->ntone; t++) {
+      struct mmc3416tone *tn = &sp->tone[t];
+      printf("%.3f Tone=%.2fHz(%.2fHz)", ts, tn->freq, tn->alias);
+      for(int a=0; a<3; a++) {
+         double mean = sp->sum[a] / SPEC_N;
+         double r = tn->sr[a] - mean * tn->gr;
+         double i = tn->si[a] - mean * tn->gi;
+         double amp = 2 * sqrt(r * r + i * i) / SPEC_N;
+         printf(" %c=%.3f", axisname[a], amp);
+      }
+      printf("\n");
+   }
+
+   for(int a=0; a<3; a++) {
+      double mean = sp->sum[a] / SPEC_N, var = 0;
+      for(int i=0; i<SPEC_N; i++) {
+         float x = sp->ring[a][(sp->pos + i) % SPEC_N] - mean;
+         var += x * x;
+         sp->re[i] = x * sp->hann[i];
+         sp->im[i] = 0;
+      }
+      fft(sp, sp->re, sp->im);
+
+      /* keep the SPEC_PEAKS strongest local maxima, DC excluded */
+      int peak[SPEC_PEAKS] = {0};
+      float pwr[SPEC_PEAKS] = {0};
+      for(int k=2; k<SPEC_N/2; k++) {
+         float p = sp->re[k] * sp->re[k] + sp->im[k] * sp->im[k];
+         float pl = sp->re[k-1] * sp->re[k-1] + sp->im[k-1] * sp->im[k-1];
+         float pr = sp->re[k+1] * sp->re[k+1] + sp->im[k+1] * sp->im[k+1];
+         if(p < pl || p < pr) continue;
+         for(int j=0; j<SPEC_PEAKS; j++) {
+            if(p > pwr[j]) {
+               memmove(&pwr[j+1], &pwr[j], (SPEC_PEAKS-j-1) * sizeof(float));
+               memmove(&peak[j+1], &peak[j], (SPEC_PEAKS-j-1) * sizeof(int));
+               pwr[j] = p; peak[j] = k;
+               break;
+            }
+         }
+      }
+      printf("%.3f Spectrum=%c RMS=%.3f Peaks=", ts, axisname[a], sqrt(var / SPEC_N));
+      for(int j=0; j<SPEC_PEAKS && peak[j] > 0; j++) {
+         /* Hann coherent gain is 0.5: amplitude = 4|X(k)|/N */
+         printf("%s%.2fHz/%.3f", j ? "," : "", peak[j] * sp->fs / SPEC_N,
+                4 * sqrt(pwr[j]) / SPEC_N);
+      }
+      printf("\n");
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * spec_add() adds a calibrated sample to the spectral window.  *
+ * ------------------------------------------------------------ */
+void spec_add(struct mmc3416spec *sp, struct mmc3416sample *s) {
+   float v[3] = { s->data.X, s->data.Y, s->data.Z };
+
+   for(int a=0; a<3; a++) {
+      float old = sp->ring[a][sp->pos];
+      sp->ring[a][sp->pos] = v[a];
+      if(sp->count >= SPEC_N) sp->sum[a] += v[a] - old;
+      else sp->sum[a] += v[a];
+
+      /* sliding Goertzel update, once the rate is known */
+      if(sp->fs > 0) {
+         for(int t=0; t<sp->ntone; t++) {
+            struct mmc3416tone *tn = &sp->tone[t];
+            double r = v[a] + tn->wr * tn->sr[a] - tn->wi * tn->si[a] - old * tn->wnr;
+            double i = tn->wr * tn->si[a] + tn->wi * tn->sr[a] - old * tn->wni;
+            tn->sr[a] = r;
+            tn->si[a] = i;
+         }
+      }
+   }
+   if(++sp->pos == SPEC_N) sp->pos = 0;
+   if(sp->count == 0) sp->tfirst = s->ts;
+   sp->count++;
+
+   if(sp->count % SPEC_N != 0) return;
+   if(sp->fs == 0) {
+      if(s->ts <= sp->tfirst) return;
+      sp->fs = (SPEC_N - 1) / (s->ts - sp->tfirst);
+      spec_start(sp);
+   }
+   spec_report(sp, s->ts);
+}
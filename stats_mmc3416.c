@@ -0,0 +1,110 @@
+/* ------------------------------------------------------------ *
+ * file:        stats_mmc3416.c                                 *
+ * purpose:     Incremental windowed statistics (rollups) for   *
+ *              the MMC3416 sample stream. Per window: count,   *
+ *              min, max, mean and variance (Welford) of X Y Z  *
+ *              and field magnitude, circular mean and variance *
+ *              of the heading. Memory use is constant per      *
+ *              window, independent of the window length.       *
+ *              This file belongs to the pi-mmc3416 package.    *
+ *                                                              *
+ * author:      18/10/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "mmc3416.h"
+
+/* ------------------------------------------------------------ *
+ * welford_add() updates running mean and sum of squared diffs  *
+ * ------------------------------------------------------------ */
+void welford_add(struct mmc3416welford *w, long n, double x) {
+   if(n == 1) {
+      w->mean = x; w->m2 = 0;
+      w->min = x; w->max = x;
+      return;
+   }
+   double delta = x - w->mean;
+   w->mean += delta / n;
+   w->m2 += delta * (x - w->mean);
+   if(x < w->min) w->min = x;
+   if(x > w->max) w->max = x;
+}
+
+/* ------------------------------------------------------------ *
+ * rollup_init() sets up a rollup with window length in seconds *
+ * ------------------------------------------------------------ */
+void rollup_init(struct mmc3416rollup *r, int len) {
+   memset(r, 0, sizeof(struct mmc3416rollup));
+   r->len = len;
+}
+
+/* ------------------------------------------------------------ *
+ * rollup_add() adds a sample to the current window. Windows    *
+ * are aligned to multiples of len seconds. When the sample     *
+ * falls into a new window, the finished window is copied to    *
+ * done and 1 is returned, otherwise 0.                         *
+ * ------------------------------------------------------------ */
+int rollup_add(struct mmc3416rollup *r, struct mmc3416sample *s,
+               struct mmc3416rollup *done) {
+   int closed = 0;
+   double start = floor(s->ts / r->len) * r->len;
+
+   if(r->count > 0 && start != r->start) {
+      *done = *r;
+      closed = 1;
+      r->count = 0;
+      r->sumsin = 0;
+      r->sumcos = 0;
+   }
+   if(r->count == 0) r->start = start;
+   r->count++;
+
+   double mag = sqrt(s->data.X * s->data.X + s->data.Y * s->data.Y
+                   + s->data.Z * s->data.Z);
+   welford_add(&r->axis[0], r->count, s->data.X);
+   welford_add(&r->axis[1], r->count, s->data.Y);
+   welford_add(&r->axis[2], r->count, s->data.Z);
+   welford_add(&r->axis[3], r->count, mag);
+
+   double rad = s->heading * M_PI / 180;
+   r->sumsin += sin(rad);
+   r->sumcos += cos(rad);
+   return(closed);
+}
+
+/* ------------------------------------------------------------ *
+ * rollup_flush() returns the incomplete last window at the end *
+ * of the stream. Returns 1 if there was data, 0 if not.        *
+ * ------------------------------------------------------------ */
+int rollup_flush(struct mmc3416rollup *r, struct mmc3416rollup *done) {
+   if(r->count == 0) return(0);
+   *done = *r;
+   r->count = 0;
+   r->sumsin = 0;
+   r->sumcos = 0;
+   return(1);
+}
+
+/* ------------------------------------------------------------ *
+ * rollup_variance() sample variance of a closed window axis    *
+ * ------------------------------------------------------------ */
+double rollup_variance(struct mmc3416rollup *r, int axis) {
+   if(r->count < 2) return(0);
+   return(r->axis[axis].m2 / (r->count - 1));
+}
+
+/* ------------------------------------------------------------ *
+ * rollup_heading() circular mean heading in degrees 0..360 and *
+ * circular variance 0..1 (1 - mean resultant length).          *
+ * ------------------------------------------------------------ */
+double rollup_heading(struct mmc3416rollup *r, double *cvar) {
+   double s = r->sumsin / r->count;
+   double c = r->sumcos / r->count;
+   *cvar = 1 - sqrt(s * s + c * c);
+   double deg = atan2(s, c) * 180 / M_PI;
+   if(deg < 0) deg += 360;
+   return(deg);
+}